@@ -3,45 +3,805 @@
 #include <vector>
 #include <string>
 #include <algorithm> // Para std::clamp (C++17)
+#include <cmath>
+#include <cstring>   // Para std::memmove
+#include <stdexcept>
+
+// Las reservas de stb_image pasan por el pool de buffers para reutilizarlas
+// entre imágenes
+#include "pool_buffers.h"
+#define STBI_MALLOC(sz)    pool_malloc(sz)
+#define STBI_REALLOC(p,sz) pool_realloc(p, sz)
+#define STBI_FREE(p)       pool_free(p)
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image.h"
 #include "stb_image_write.h"
 
-// Función para ajustar el brillo (0.0 = negro, 1.0 = normal, >1.0 más brillante)
-unsigned char adjust_brightness(unsigned char pixel, float brightness) {
-    float adjusted = pixel * brightness;
-    return static_cast<unsigned char>(std::clamp(adjusted, 0.0f, 255.0f));
+#include "conversion_gris.h"
+#include "convolucion.h"
+#include "redimension.h"
+#include "histograma.h"
+#include "pool_hilos.h"
+#include "lote.h"
+#include "jpeg_gris.h"
+#include "franjas.h"
+#include "memoria.h"
+#include "mapeo.h"
+#include "salida_cruda.h"
+#include "multisalida.h"
+#include "huella.h"
+
+// Opciones de línea de comandos
+struct Opciones {
+    std::string input_file;
+    std::string output_file;       // vacío = grayscale.jpg (o "gris" en modo lote)
+    float brightness = 1.0f;       // 1.0 = brillo normal
+    ModoGris modo = ModoGris::Promedio;
+    bool fusionar_brillo = false;  // brillo dentro de los pesos de punto fijo
+    CadenaPuntos operaciones;      // gamma, contraste, niveles y curvas, en orden
+    std::vector<Filtro> filtros;   // desenfoque, enfoque y sobel, en orden
+    std::vector<std::pair<int, int>> miniaturas;  // ancho x alto (alto 0 = proporcional)
+    FiltroEscala filtro_escala = FiltroEscala::Lanczos3;
+    AjusteAuto ajuste_auto = AjusteAuto::Ninguno;  // niveles o ecualización según el histograma
+    double recorte = 0.005;        // fracción ignorada en cada extremo con --auto niveles
+    std::string histograma;        // CSV del histograma final (vacío = no se escribe)
+    std::string ruta;              // vacío = detectar la mejor ruta SIMD
+    unsigned hilos = hilos_por_defecto();
+    bool benchmark = false;        // medir todas las rutas y salir
+    bool lote = false;             // entrada = directorio o lista de ficheros
+    unsigned hilos_carga = hilos_por_defecto();
+    unsigned hilos_guardado = hilos_por_defecto();
+    size_t capacidad_cola = 8;
+    bool en_sitio = false;         // escribir el gris sobre el buffer de stbi_load
+    bool streaming = false;        // cargar, convertir y guardar por franjas
+    int alto_franja = 64;          // filas por franja en modo streaming
+    bool guardar_stb = false;      // guardar con stbi_write_jpg (un hilo)
+    FormatoSalida formato = FormatoSalida::Jpeg;   // con --formato; si no, según la extensión
+    bool formato_explicito = false;
+    ModoEscritura escritura = ModoEscritura::Normal;  // PGM y crudo: writev, O_DIRECT o mmap
+    std::vector<SalidaTrabajo> trabajo;  // salidas derivadas de una sola decodificación
+    bool huellas = false;          // aHash/dHash/pHash en salida.hash
+    bool decodificar_gris = false; // cargar solo la luminancia (Y del JPEG)
+    bool mmap = false;             // decodificar desde el fichero proyectado
+    bool comparar_carga = false;   // medir stdio, read y mmap y salir
+};
+
+void mostrar_uso(const char* programa) {
+    std::cerr << "Uso: " << programa << " <imagen.jpg> [salida.jpg] [brillo] [opciones]\n";
+    std::cerr << "     " << programa << " --lote <directorio|lista.txt> [dir_salida] [brillo] [opciones]\n";
+    std::cerr << "Opciones:\n";
+    std::cerr << "  --ruta escalar|sse2|avx2   Forzar la ruta de conversion\n";
+    std::cerr << "  --luma promedio|bt601|bt709  Pesos RGB del gris (por defecto: promedio)\n";
+    std::cerr << "  --fusionar-brillo          Aplicar el brillo dentro de los pesos enteros\n";
+    std::cerr << "  --gamma G                  Corregir gamma (>1 aclara los medios tonos)\n";
+    std::cerr << "  --contraste C              Escalar el contraste alrededor del gris medio\n";
+    std::cerr << "  --niveles NEGRO BLANCO     Estirar el rango [NEGRO, BLANCO] a [0, 255]\n";
+    std::cerr << "  --curva fichero.txt        Curva por puntos \"entrada salida\" por linea\n";
+    std::cerr << "  --desenfoque SIGMA         Desenfoque gaussiano del gris\n";
+    std::cerr << "  --enfoque SIGMA CANTIDAD   Mascara de enfoque (cantidad 1 = doble detalle)\n";
+    std::cerr << "  --sobel                    Mapa de bordes de Sobel\n";
+    std::cerr << "  --trabajo FICHERO          Varias salidas de una sola decodificacion (una por linea)\n";
+    std::cerr << "  --salida \"RUTA [op=valor...]\"  Anadir una salida al trabajo (repetible)\n";
+    std::cerr << "  --huellas                  Escribir aHash, dHash y pHash junto a la salida (.hash)\n";
+    std::cerr << "  --auto niveles|ecualizar   Ajustar los niveles segun el histograma (en vez del brillo a mano)\n";
+    std::cerr << "  --recorte PCT              Porcentaje ignorado en cada extremo con --auto niveles (por defecto: 0.5)\n";
+    std::cerr << "  --histograma FICHERO       Escribir el histograma de la salida en CSV\n";
+    std::cerr << "  --miniatura ANCHO[xALTO]   Guardar tambien una miniatura (repetible)\n";
+    std::cerr << "  --filtro-escala caja|bilineal|lanczos  Filtro de las miniaturas (por defecto: lanczos)\n";
+    std::cerr << "  --hilos N                  Hilos de conversion (por defecto: " << hilos_por_defecto() << ")\n";
+    std::cerr << "  --bench                    Medir megapixeles/s de cada ruta\n";
+    std::cerr << "  --decodificar-gris         Cargar solo la luminancia (Y de JPEG) y aplicarle la tabla\n";
+    std::cerr << "  --mmap                     Decodificar desde el fichero proyectado en memoria\n";
+    std::cerr << "  --comparar-carga           Medir la carga con stdio, read y mmap\n";
+    std::cerr << "  --en-sitio                 Convertir sobre el buffer RGB sin reservar gray_img\n";
+    std::cerr << "  --streaming                Procesar por franjas con memoria acotada\n";
+    std::cerr << "  --alto-franja N            Filas por franja (por defecto: 64)\n";
+    std::cerr << "  --guardar-stb              Guardar con stbi_write_jpg en vez del codificador paralelo\n";
+    std::cerr << "  --formato jpg|pgm|raw      Formato de salida (por defecto: segun la extension; jpg en lote)\n";
+    std::cerr << "  --escritura normal|directa|mapeada  Escritura de pgm/raw: writev, O_DIRECT o mmap\n";
+    std::cerr << "  --lote                     Procesar un directorio o una lista de ficheros\n";
+    std::cerr << "  --hilos-carga N            Hilos de decodificacion en modo lote\n";
+    std::cerr << "  --hilos-guardado N         Hilos de codificacion en modo lote\n";
+    std::cerr << "  --cola N                   Imagenes en vuelo entre etapas (por defecto: 8)\n";
+    std::cerr << "Ejemplos:\n";
+    std::cerr << "  " << programa << " entrada.jpg\n";
+    std::cerr << "  " << programa << " entrada.jpg salida.jpg 1.5\n";
+    std::cerr << "  " << programa << " entrada.jpg salida.jpg 0.8\n";
+    std::cerr << "  " << programa << " entrada.jpg --bench\n";
+    std::cerr << "  " << programa << " entrada.jpg salida.jpg 1.1 --gamma 1.4 --contraste 1.2\n";
+    std::cerr << "  " << programa << " escaneo.ppm escaneo_gris.jpg --streaming\n";
+    std::cerr << "  " << programa << " --lote fotos/ fotos_gris/ 1.2\n";
+}
+
+// Procesa argumentos: posicionales (entrada, salida, brillo) y opciones --x
+bool parse_args(int argc, char* argv[], Opciones& op) {
+    int posicional = 0;
+    // std::stod/stoi lanzan con texto no numérico o fuera de rango; argv[i] es
+    // el valor que se estaba leyendo
+    int i = 1;
+    try {
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--bench") {
+                op.benchmark = true;
+            } else if (arg == "--lote") {
+                op.lote = true;
+            } else if (arg == "--en-sitio") {
+                op.en_sitio = true;
+            } else if (arg == "--streaming") {
+                op.streaming = true;
+            } else if (arg == "--guardar-stb") {
+                op.guardar_stb = true;
+            } else if (arg == "--decodificar-gris") {
+                op.decodificar_gris = true;
+            } else if (arg == "--mmap") {
+                op.mmap = true;
+            } else if (arg == "--comparar-carga") {
+                op.comparar_carga = true;
+            } else if (arg == "--fusionar-brillo") {
+                op.fusionar_brillo = true;
+            } else if (arg == "--luma" && i + 1 < argc) {
+                std::string modo = argv[++i];
+                if (modo == "promedio") op.modo = ModoGris::Promedio;
+                else if (modo == "bt601") op.modo = ModoGris::BT601;
+                else if (modo == "bt709") op.modo = ModoGris::BT709;
+                else {
+                    std::cerr << "Modo de luma desconocido: " << modo << "\n";
+                    return false;
+                }
+            } else if (arg == "--gamma" && i + 1 < argc) {
+                double gamma = std::stod(argv[++i]);
+                if (!std::isfinite(gamma) || gamma <= 0.0) {
+                    std::cerr << "--gamma necesita un valor positivo\n";
+                    return false;
+                }
+                op.operaciones.gamma(gamma);
+            } else if (arg == "--contraste" && i + 1 < argc) {
+                double contraste = std::stod(argv[++i]);
+                if (!std::isfinite(contraste)) {
+                    std::cerr << "--contraste necesita un valor finito\n";
+                    return false;
+                }
+                op.operaciones.contraste(contraste);
+            } else if (arg == "--niveles" && i + 2 < argc) {
+                double negro = std::stod(argv[++i]);
+                double blanco = std::stod(argv[++i]);
+                if (!std::isfinite(negro) || !std::isfinite(blanco) || blanco <= negro) {
+                    std::cerr << "--niveles necesita NEGRO < BLANCO\n";
+                    return false;
+                }
+                op.operaciones.niveles(negro, blanco);
+            } else if (arg == "--curva" && i + 1 < argc) {
+                try {
+                    op.operaciones.agregar(leer_curva(argv[++i]));
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << "\n";
+                    return false;
+                }
+            } else if ((arg == "--desenfoque" && i + 1 < argc) || (arg == "--enfoque" && i + 2 < argc)) {
+                double sigma = std::stod(argv[++i]);
+                if (!std::isfinite(sigma) || sigma <= 0.0) {
+                    std::cerr << arg << " necesita SIGMA positivo\n";
+                    return false;
+                }
+                double cantidad = arg == "--enfoque" ? std::stod(argv[++i]) : 1.0;
+                if (!std::isfinite(cantidad) || cantidad < 0.0) {
+                    std::cerr << "--enfoque necesita una CANTIDAD finita y no negativa\n";
+                    return false;
+                }
+                op.filtros.push_back({arg == "--enfoque" ? TipoFiltro::Enfoque : TipoFiltro::Desenfoque, sigma, cantidad});
+            } else if (arg == "--sobel") {
+                op.filtros.push_back({TipoFiltro::Sobel, 1.0, 1.0});
+            } else if (arg == "--formato" && i + 1 < argc) {
+                std::string formato = argv[++i];
+                if (formato == "jpg") op.formato = FormatoSalida::Jpeg;
+                else if (formato == "pgm") op.formato = FormatoSalida::Pgm;
+                else if (formato == "raw") op.formato = FormatoSalida::Crudo;
+                else {
+                    std::cerr << "Formato desconocido: " << formato << "\n";
+                    return false;
+                }
+                op.formato_explicito = true;
+            } else if (arg == "--escritura" && i + 1 < argc) {
+                std::string modo = argv[++i];
+                if (modo == "normal") op.escritura = ModoEscritura::Normal;
+                else if (modo == "directa") op.escritura = ModoEscritura::Directa;
+                else if (modo == "mapeada") op.escritura = ModoEscritura::Mapeada;
+                else {
+                    std::cerr << "Modo de escritura desconocido: " << modo << "\n";
+                    return false;
+                }
+            } else if ((arg == "--trabajo" || arg == "--salida") && i + 1 < argc) {
+                try {
+                    if (arg == "--trabajo") {
+                        for (auto& salida : leer_trabajos(argv[++i])) op.trabajo.push_back(std::move(salida));
+                    } else {
+                        op.trabajo.push_back(leer_salida(argv[++i]));
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << "\n";
+                    return false;
+                }
+            } else if (arg == "--huellas") {
+                op.huellas = true;
+            } else if (arg == "--auto" && i + 1 < argc) {
+                std::string ajuste = argv[++i];
+                if (ajuste == "niveles") op.ajuste_auto = AjusteAuto::Niveles;
+                else if (ajuste == "ecualizar") op.ajuste_auto = AjusteAuto::Ecualizar;
+                else {
+                    std::cerr << "Ajuste automatico desconocido: " << ajuste << "\n";
+                    return false;
+                }
+            } else if (arg == "--recorte" && i + 1 < argc) {
+                op.recorte = std::stod(argv[++i]) / 100.0;
+                if (!(op.recorte >= 0.0 && op.recorte < 0.5)) {
+                    std::cerr << "El recorte debe estar en [0, 50)\n";
+                    return false;
+                }
+            } else if (arg == "--histograma" && i + 1 < argc) {
+                op.histograma = argv[++i];
+            } else if (arg == "--miniatura" && i + 1 < argc) {
+                std::string tam = argv[++i];
+                size_t x = tam.find('x');
+                int ancho = std::stoi(tam.substr(0, x));
+                int alto = x == std::string::npos ? 0 : std::stoi(tam.substr(x + 1));
+                if (ancho < 1 || alto < 0) {
+                    std::cerr << "Tamano de miniatura no valido: " << tam << "\n";
+                    return false;
+                }
+                op.miniaturas.emplace_back(ancho, alto);
+            } else if (arg == "--filtro-escala" && i + 1 < argc) {
+                std::string filtro = argv[++i];
+                if (filtro == "caja") op.filtro_escala = FiltroEscala::Caja;
+                else if (filtro == "bilineal") op.filtro_escala = FiltroEscala::Bilineal;
+                else if (filtro == "lanczos") op.filtro_escala = FiltroEscala::Lanczos3;
+                else {
+                    std::cerr << "Filtro de escala desconocido: " << filtro << "\n";
+                    return false;
+                }
+            } else if (arg == "--ruta" && i + 1 < argc) {
+                op.ruta = argv[++i];
+            } else if ((arg == "--hilos" || arg == "--hilos-carga" || arg == "--hilos-guardado" ||
+                        arg == "--cola" || arg == "--alto-franja") && i + 1 < argc) {
+                int n = std::stoi(argv[++i]);
+                if (n < 1) {
+                    std::cerr << arg << " debe ser al menos 1\n";
+                    return false;
+                }
+                if (arg == "--hilos") op.hilos = static_cast<unsigned>(n);
+                else if (arg == "--hilos-carga") op.hilos_carga = static_cast<unsigned>(n);
+                else if (arg == "--hilos-guardado") op.hilos_guardado = static_cast<unsigned>(n);
+                else if (arg == "--alto-franja") op.alto_franja = n;
+                else op.capacidad_cola = static_cast<size_t>(n);
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Opcion desconocida o sin valor: " << arg << "\n";
+                return false;
+            } else {
+                switch (posicional++) {
+                    case 0: op.input_file = arg; break;
+                    case 1: op.output_file = arg; break;
+                    case 2:
+                        op.brightness = std::stof(arg);
+                        if (!std::isfinite(op.brightness) || op.brightness < 0.0f) {
+                            std::cerr << "El brillo debe ser un numero no negativo\n";
+                            return false;
+                        }
+                        break;
+                    default:
+                        std::cerr << "Argumento de mas: " << arg << "\n";
+                        return false;
+                }
+            }
+        }
+    } catch (const std::invalid_argument&) {
+        std::cerr << "Valor no numerico: " << argv[i] << "\n";
+        return false;
+    } catch (const std::out_of_range&) {
+        std::cerr << "Valor fuera de rango: " << argv[i] << "\n";
+        return false;
+    }
+    if (op.output_file.empty()) op.output_file = op.lote ? "gris" : "grayscale.jpg";
+    if (!op.formato_explicito && !op.lote) op.formato = formato_por_extension(op.output_file);
+    if (op.streaming && (op.formato != FormatoSalida::Jpeg || op.huellas)) {
+        std::cerr << "--streaming solo guarda JPEG, sin huellas\n";
+        return false;
+    }
+    if (op.decodificar_gris && (op.lote || op.streaming || op.benchmark)) {
+        std::cerr << "--decodificar-gris no se combina con --lote, --streaming ni --bench\n";
+        return false;
+    }
+    if ((!op.filtros.empty() || !op.miniaturas.empty()) && (op.lote || op.streaming)) {
+        std::cerr << "Los filtros y las miniaturas no se combinan con --lote ni --streaming\n";
+        return false;
+    }
+    if ((op.ajuste_auto != AjusteAuto::Ninguno || !op.histograma.empty()) && (op.lote || op.streaming)) {
+        std::cerr << "--auto y --histograma no se combinan con --lote ni --streaming\n";
+        return false;
+    }
+    if (!op.trabajo.empty() && (op.lote || op.streaming || !op.filtros.empty() || !op.miniaturas.empty() ||
+                                op.ajuste_auto != AjusteAuto::Ninguno || !op.histograma.empty() || op.huellas)) {
+        std::cerr << "--trabajo y --salida no se combinan con --lote, --streaming, filtros, miniaturas,"
+                     " --auto, --histograma ni --huellas (cada salida lleva sus opciones)\n";
+        return false;
+    }
+    return !op.input_file.empty();
+}
+
+// Convierte la imagen con cada ruta soportada, comprueba que el resultado
+// coincide con la ruta escalar y muestra megapixeles por segundo
+void benchmark_rutas(const unsigned char* img, int width, int height, const ParametrosGris& parametros) {
+    const size_t n = static_cast<size_t>(width) * height;
+    const int repeticiones = 10;
+    std::vector<unsigned char> referencia(n);
+    std::vector<unsigned char> salida(n);
+    convertir_gris_escalar(img, referencia.data(), n, parametros);
+
+    std::cout << "\nBenchmark (" << repeticiones << " repeticiones):\n";
+    for (RutaSimd ruta : {RutaSimd::Escalar, RutaSimd::SSE2, RutaSimd::AVX2}) {
+        if (!ruta_soportada(ruta)) {
+            std::cout << "  " << nombre_ruta(ruta) << ": no soportada por la CPU\n";
+            continue;
+        }
+        convertir_gris(img, salida.data(), n, parametros, ruta); // calentamiento
+        auto inicio = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeticiones; ++r) {
+            convertir_gris(img, salida.data(), n, parametros, ruta);
+        }
+        auto fin = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> segundos = fin - inicio;
+        double mpx_s = (n / 1e6) * repeticiones / segundos.count();
+        bool identico = salida == referencia;
+        std::cout << "  " << nombre_ruta(ruta) << ": " << mpx_s << " MP/s"
+                  << (identico ? "" : "  (ERROR: difiere de la ruta escalar)") << "\n";
+    }
+}
+
+// Banda horizontal de filas convertida por un hilo
+struct Banda {
+    int fila_inicio = 0;
+    int fila_fin = 0;    // exclusiva
+    double ms = 0.0;
+};
+
+// Píxeles por tramo al fusionar conversión e histograma: el gris recién
+// escrito se cuenta mientras sigue en la caché L2
+constexpr size_t TRAMO_HISTOGRAMA = 64 * 1024;
+
+// Para decidir el ajuste automático basta una fila de cada MUESTREO_AUTO:
+// contar cada píxel cuesta casi tanto como convertirlo
+constexpr int MUESTREO_AUTO = 4;
+
+// Recorre las filas [fila_inicio, fila_fin) en tramos de unos
+// TRAMO_HISTOGRAMA píxeles; procesar(primera, filas) trabaja el tramo y
+// contar(fila) indica si la fila entra en el histograma
+template <typename Procesar>
+void recorrer_tramos(int fila_inicio, int fila_fin, int width, int paso_filas, const unsigned char* salida,
+                     Histograma& local, Procesar procesar) {
+    const int filas_tramo = std::max(1, static_cast<int>(TRAMO_HISTOGRAMA / std::max(1, width)));
+    for (int y = fila_inicio; y < fila_fin; y += filas_tramo) {
+        const int filas = std::min(filas_tramo, fila_fin - y);
+        procesar(y, filas);
+        for (int f = y; f < y + filas; ++f) {
+            if (f % paso_filas == 0) {
+                acumular_histograma(salida + static_cast<size_t>(f - fila_inicio) * width, width, local);
+            }
+        }
+    }
+}
+
+// Suma los histogramas de cada banda
+void sumar_histogramas(const std::vector<Histograma>& parciales, Histograma* histograma) {
+    if (!histograma) return;
+    *histograma = Histograma{};
+    for (const Histograma& p : parciales)
+        for (int v = 0; v < 256; ++v) (*histograma)[v] += p[v];
+}
+
+// Reparte la conversión en bandas de filas, una por hilo del pool.
+// Con gray == nullptr cada banda escribe su gris al inicio de su tramo RGB.
+// Con histograma != nullptr se cuenta además el gris de salida en la misma
+// pasada, una fila de cada paso_filas.
+std::vector<Banda> convertir_gris_bandas(PoolHilos& pool, const unsigned char* img,
+                                         unsigned char* gray, int width, int height,
+                                         const ParametrosGris& parametros, RutaSimd ruta,
+                                         Histograma* histograma = nullptr, int paso_filas = 1) {
+    const int n_bandas = std::max(1, std::min(static_cast<int>(pool.size()), height));
+    std::vector<Banda> bandas(n_bandas);
+    std::vector<Histograma> parciales(histograma ? n_bandas : 0, Histograma{});
+    pool.paralelo_para(n_bandas, [&](size_t b) {
+        Banda& banda = bandas[b];
+        banda.fila_inicio = static_cast<int>(static_cast<long long>(height) * b / n_bandas);
+        banda.fila_fin = static_cast<int>(static_cast<long long>(height) * (b + 1) / n_bandas);
+        const size_t primero = static_cast<size_t>(banda.fila_inicio) * width;
+        const size_t n = static_cast<size_t>(banda.fila_fin - banda.fila_inicio) * width;
+
+        auto inicio = std::chrono::high_resolution_clock::now();
+        unsigned char* destino = gray ? gray + primero
+                                      : const_cast<unsigned char*>(img) + primero * 3;
+        if (histograma) {
+            Histograma local{};
+            recorrer_tramos(banda.fila_inicio, banda.fila_fin, width, paso_filas, destino, local,
+                            [&](int y, int filas) {
+                const size_t i = static_cast<size_t>(y - banda.fila_inicio) * width;
+                convertir_gris(img + (primero + i) * 3, destino + i, static_cast<size_t>(filas) * width,
+                               parametros, ruta);
+            });
+            parciales[b] = local;
+        } else {
+            convertir_gris(img + primero * 3, destino, n, parametros, ruta);
+        }
+        auto fin = std::chrono::high_resolution_clock::now();
+        banda.ms = std::chrono::duration<double, std::milli>(fin - inicio).count();
+    });
+    sumar_histogramas(parciales, histograma);
+    return bandas;
+}
+
+// Con --decodificar-gris la imagen ya llega en gris: solo queda aplicar la
+// tabla de operaciones de punto, en el sitio y por bandas de filas (y contar
+// el resultado si se pide histograma). También es la segunda pasada de --auto.
+std::vector<Banda> aplicar_lut_bandas(PoolHilos& pool, unsigned char* gray, int width, int height,
+                                      const ParametrosGris& parametros, RutaSimd ruta,
+                                      Histograma* histograma = nullptr, int paso_filas = 1) {
+    const int n_bandas = std::max(1, std::min(static_cast<int>(pool.size()), height));
+    std::vector<Banda> bandas(n_bandas);
+    std::vector<Histograma> parciales(histograma ? n_bandas : 0, Histograma{});
+    pool.paralelo_para(n_bandas, [&](size_t b) {
+        Banda& banda = bandas[b];
+        banda.fila_inicio = static_cast<int>(static_cast<long long>(height) * b / n_bandas);
+        banda.fila_fin = static_cast<int>(static_cast<long long>(height) * (b + 1) / n_bandas);
+        const size_t primero = static_cast<size_t>(banda.fila_inicio) * width;
+        const size_t n = static_cast<size_t>(banda.fila_fin - banda.fila_inicio) * width;
+
+        auto inicio = std::chrono::high_resolution_clock::now();
+        if (histograma) {
+            Histograma local{};
+            recorrer_tramos(banda.fila_inicio, banda.fila_fin, width, paso_filas, gray + primero, local,
+                            [&](int y, int filas) {
+                unsigned char* tramo = gray + static_cast<size_t>(y) * width;
+                if (parametros.usar_lut) {
+                    aplicar_lut(tramo, tramo, static_cast<size_t>(filas) * width, parametros.lut, ruta);
+                }
+            });
+            parciales[b] = local;
+        } else if (parametros.usar_lut) {
+            aplicar_lut(gray + primero, gray + primero, n, parametros.lut, ruta);
+        }
+        auto fin = std::chrono::high_resolution_clock::now();
+        banda.ms = std::chrono::duration<double, std::milli>(fin - inicio).count();
+    });
+    sumar_histogramas(parciales, histograma);
+    return bandas;
+}
+
+// Conversión en el propio buffer RGB: la salida del píxel i va en img[i] y
+// su entrada empieza en img[3i], así que nunca se pisa un píxel pendiente.
+// Para poder usar varios hilos, cada banda compacta primero su gris al inicio
+// de su propio tramo RGB (los tramos no se solapan) y después los tramos se
+// mueven a su sitio final en orden de banda.
+std::vector<Banda> convertir_gris_en_sitio(PoolHilos& pool, unsigned char* img,
+                                           int width, int height,
+                                           const ParametrosGris& parametros, RutaSimd ruta,
+                                           Histograma* histograma = nullptr, int paso_filas = 1) {
+    std::vector<Banda> bandas = convertir_gris_bandas(pool, img, nullptr, width, height, parametros, ruta,
+                                                      histograma, paso_filas);
+    for (const Banda& banda : bandas) {
+        const size_t primero = static_cast<size_t>(banda.fila_inicio) * width;
+        const size_t n = static_cast<size_t>(banda.fila_fin - banda.fila_inicio) * width;
+        std::memmove(img + primero, img + primero * 3, n);
+    }
+    return bandas;
+}
+
+// Miniatura de salida.jpg a 320x240 -> salida_320x240.jpg
+std::string ruta_miniatura(const std::string& salida, int ancho, int alto) {
+    std::filesystem::path p(salida);
+    p.replace_filename(p.stem().string() + "_" + std::to_string(ancho) + "x" + std::to_string(alto) +
+                       p.extension().string());
+    return p.string();
+}
+
+// Compara tres formas de cargar la misma imagen, con la caché de páginas
+// caliente: stbi_load (stdio), leer el fichero entero y decodificar de
+// memoria, y proyectarlo con mmap y decodificar de la proyección
+int comparar_carga(const Opciones& op) {
+    using reloj = std::chrono::high_resolution_clock;
+    auto ms_entre = [](reloj::time_point a, reloj::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    const int canales = op.decodificar_gris ? 1 : 3;
+    const int repeticiones = 5;
+    std::vector<double> stdio_ms, read_ms, read_dec_ms, mmap_ms, mmap_dec_ms;
+    int width = 0, height = 0, orig_channels = 0;
+
+    // Calentamiento: deja el fichero en la caché de páginas
+    stbi_image_free(stbi_load(op.input_file.c_str(), &width, &height, &orig_channels, canales));
+
+    for (int r = 0; r < repeticiones; ++r) {
+        auto t0 = reloj::now();
+        unsigned char* img = stbi_load(op.input_file.c_str(), &width, &height, &orig_channels, canales);
+        auto t1 = reloj::now();
+        if (!img) {
+            std::cerr << "Error cargando la imagen: " << stbi_failure_reason() << "\n";
+            return 1;
+        }
+        stbi_image_free(img);
+        stdio_ms.push_back(ms_entre(t0, t1));
+
+        for (bool usar_mmap : {false, true}) {
+            if (usar_mmap && !MMAP_DISPONIBLE) continue;
+            auto a = reloj::now();
+            FicheroMapeado fichero;
+            bool ok = usar_mmap ? fichero.abrir(op.input_file) : fichero.leer(op.input_file);
+            auto b = reloj::now();
+            if (!ok) {
+                std::cerr << "Error leyendo " << op.input_file << ": " << fichero.error() << "\n";
+                return 1;
+            }
+            img = stbi_load_from_memory(fichero.datos(), static_cast<int>(fichero.size()),
+                                        &width, &height, &orig_channels, canales);
+            auto c = reloj::now();
+            stbi_image_free(img);
+            (usar_mmap ? mmap_ms : read_ms).push_back(ms_entre(a, b));
+            (usar_mmap ? mmap_dec_ms : read_dec_ms).push_back(ms_entre(b, c));
+        }
+    }
+
+    auto mediana = [](const std::vector<double>& v) { return percentil(v, 50); };
+    std::cout << "\nCarga de " << op.input_file << " (" << width << " x " << height << " px, "
+              << canales << (canales == 1 ? " canal" : " canales") << ", mediana de "
+              << repeticiones << ", cache caliente):\n";
+    std::cout << "  stdio (stbi_load): " << mediana(stdio_ms) << " ms\n";
+    std::cout << "  read + memoria:    " << mediana(read_ms) + mediana(read_dec_ms) << " ms (lectura "
+              << mediana(read_ms) << " ms + decodificacion " << mediana(read_dec_ms) << " ms)\n";
+    if (MMAP_DISPONIBLE) {
+        std::cout << "  mmap + memoria:    " << mediana(mmap_ms) + mediana(mmap_dec_ms) << " ms (mmap "
+                  << mediana(mmap_ms) << " ms + decodificacion " << mediana(mmap_dec_ms) << " ms)\n";
+    } else {
+        std::cout << "  mmap + memoria:    no disponible en este sistema\n";
+    }
+    return 0;
+}
+
+void mostrar_estadisticas_buffers() {
+    PoolBuffers::Estadisticas e = pool_buffers().estadisticas();
+    std::cout << "  Buffers: " << e.reservas << " reservas grandes (" << e.reservas_sistema
+              << " nuevas, " << e.reutilizadas << " reutilizadas, "
+              << bytes_a_mb(e.bytes_reutilizados) << " MB reutilizados), "
+              << e.reservas_pequenas << " pequenas\n";
+}
+
+// Modo lote: tubería carga -> conversión -> guardado y resumen de latencias
+int ejecutar_lote(const Opciones& op, const ParametrosGris& parametros, RutaSimd ruta) {
+    ConfigLote cfg;
+    cfg.entrada = op.input_file;
+    cfg.dir_salida = op.output_file;
+    cfg.parametros = parametros;
+    cfg.ruta = ruta;
+    cfg.hilos_carga = op.hilos_carga;
+    cfg.hilos_conversion = op.hilos;
+    cfg.hilos_guardado = op.hilos_guardado;
+    cfg.capacidad_cola = op.capacidad_cola;
+    cfg.usar_mmap = op.mmap;
+    cfg.formato = op.formato;
+    cfg.escritura = op.escritura;
+    cfg.huellas = op.huellas;
+
+    ResultadoLote res = procesar_lote(cfg);
+    if (!res.fallo.empty()) {
+        std::cerr << "Error: " << res.fallo << "\n";
+        return 1;
+    }
+
+    std::cout << "\nResultados (lote):\n";
+    std::cout << "  Imagenes: " << res.imagenes << " guardadas, " << res.errores << " con error\n";
+    std::cout << "  Hilos: " << cfg.hilos_carga << " carga, " << cfg.hilos_conversion
+              << " conversion, " << cfg.hilos_guardado << " guardado\n";
+    std::cout << "  Tiempo total: " << res.segundos * 1000.0 << " ms\n";
+    std::cout << "  Rendimiento: " << (res.segundos > 0 ? res.imagenes / res.segundos : 0.0) << " imagenes/s\n";
+    const std::pair<const char*, const std::vector<double>*> etapas[] = {
+        {"carga", &res.ms_carga}, {"conversion", &res.ms_conversion}, {"guardado", &res.ms_guardado}
+    };
+    for (const auto& [nombre, ms] : etapas) {
+        std::cout << "  Tiempo " << nombre << ": p50 " << percentil(*ms, 50) << " ms, p99 "
+                  << percentil(*ms, 99) << " ms\n";
+    }
+    mostrar_estadisticas_buffers();
+    std::cout << "  Imagenes guardadas en: " << cfg.dir_salida << "\n";
+    return res.errores == 0 ? 0 : 1;
+}
+
+// Modo trabajo: todas las salidas de op.trabajo desde la imagen ya cargada
+int ejecutar_trabajo(const Opciones& op, PoolHilos& pool, const unsigned char* img, int canales,
+                     int width, int height, const ParametrosGris& parametros, const CadenaPuntos& global,
+                     RutaSimd ruta, double ms_carga) {
+    ResultadoMultisalida res = ejecutar_multisalida(pool, img, canales, width, height, parametros, global,
+                                                    op.trabajo, ruta, op.escritura);
+    const double megapixeles = static_cast<double>(width) * height / 1e6;
+    size_t errores = 0;
+
+    std::cout << "\nResultados (trabajo, " << op.trabajo.size() << " salidas):\n";
+    std::cout << "  Dimensiones: " << width << " x " << height << " px\n";
+    std::cout << "  Tiempo carga: " << ms_carga << " ms (una sola decodificacion)\n";
+    std::cout << "  Pasada fusionada: " << res.ms_pasada << " ms (" << res.tablas << " tablas, "
+              << megapixeles / (res.ms_pasada / 1000.0) << " MP/s)\n";
+    std::cout << "  Miniaturas: " << res.ms_escala << " ms\n";
+    std::cout << "  Codificacion y escritura: " << res.ms_codificacion << " ms (" << pool.size() << " hilos)\n";
+    for (size_t i = 0; i < op.trabajo.size(); ++i) {
+        const SalidaTrabajo& s = op.trabajo[i];
+        const ResultadoSalida& r = res.salidas[i];
+        std::cout << "    " << s.ruta << ": ";
+        if (s.histograma) std::cout << "histograma";
+        else std::cout << r.ancho << "x" << r.alto << " " << nombre_formato(s.formato) << ", " << r.bytes << " bytes";
+        std::cout << ", tabla " << r.tabla << (r.ok ? "" : " (ERROR)") << "\n";
+        if (!r.ok) {
+            std::cerr << "Error guardando " << s.ruta << "\n";
+            ++errores;
+        }
+    }
+    std::cout << "  Memoria pico (RSS): " << bytes_a_mb(memoria_pico_bytes()) << " MB\n";
+    mostrar_estadisticas_buffers();
+    return errores == 0 ? 0 : 1;
+}
+
+// Modo streaming: carga, conversión y guardado franja a franja. La memoria
+// pico es O(ancho x alto de franja) si la entrada es PNM; con otros formatos
+// la decodificación sigue siendo completa, pero no se reserva gray_img entero.
+int ejecutar_streaming(const Opciones& op, const ParametrosGris& parametros,
+                       RutaSimd ruta, PoolHilos& pool) {
+    using reloj = std::chrono::high_resolution_clock;
+    auto ms_entre = [](reloj::time_point a, reloj::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    auto start = reloj::now();
+    LectorFranjas lector;
+    if (!lector.abrir(op.input_file)) {
+        std::cerr << "Error cargando la imagen: " << lector.error() << "\n";
+        return 1;
+    }
+    const int width = lector.width();
+    const int height = lector.height();
+    double ms_carga = ms_entre(start, reloj::now());
+    double ms_conversion = 0.0;
+    double ms_guardado = 0.0;
+
+    EscritorJpegGris escritor;
+    if (!escritor.abrir(op.output_file, width, height, 90)) {
+        std::cerr << "Error guardando la imagen: " << op.output_file << "\n";
+        return 1;
+    }
+
+    std::vector<unsigned char> franja_gris(static_cast<size_t>(width) * op.alto_franja);
+    bool ok = true;
+    for (int y = 0; y < height && ok; y += op.alto_franja) {
+        const int n = std::min(op.alto_franja, height - y);
+        auto t0 = reloj::now();
+        const unsigned char* rgb = lector.leer(n);
+        auto t1 = reloj::now();
+        if (!rgb) {
+            std::cerr << "Error cargando la imagen: " << lector.error() << "\n";
+            ok = false;
+            break;
+        }
+        convertir_gris_bandas(pool, rgb, franja_gris.data(), width, n, parametros, ruta);
+        auto t2 = reloj::now();
+        ok = escritor.escribir_filas(franja_gris.data(), n);
+        auto t3 = reloj::now();
+        ms_carga += ms_entre(t0, t1);
+        ms_conversion += ms_entre(t1, t2);
+        ms_guardado += ms_entre(t2, t3);
+    }
+    auto t_cierre = reloj::now();
+    ok = escritor.cerrar() && ok;
+    auto end = reloj::now();
+    ms_guardado += ms_entre(t_cierre, end);
+    if (!ok) {
+        std::cerr << "Error guardando la imagen: " << op.output_file << "\n";
+    }
+
+    double megapixeles = static_cast<double>(width) * height / 1e6;
+    std::cout << "\nResultados (streaming, franjas de " << op.alto_franja << " filas):\n";
+    std::cout << "  Dimensiones: " << width << " x " << height << " px\n";
+    std::cout << "  Decodificacion: " << (lector.por_franjas() ? "por franjas (PNM)"
+                                                               : "completa (formato sin lectura incremental)") << "\n";
+    std::cout << "  Tiempo carga: " << static_cast<long long>(ms_carga) << " ms\n";
+    std::cout << "  Tiempo conversion: " << static_cast<long long>(ms_conversion) << " ms ("
+              << nombre_ruta(ruta) << ", " << pool.size() << " hilos, "
+              << megapixeles / (ms_conversion / 1000.0) << " MP/s)\n";
+    std::cout << "  Tiempo guardado: " << static_cast<long long>(ms_guardado) << " ms\n";
+    std::cout << "  Tiempo total: " << static_cast<long long>(ms_entre(start, end)) << " ms\n";
+    std::cout << "  Memoria pico (RSS): " << bytes_a_mb(memoria_pico_bytes()) << " MB\n";
+    std::cout << "  Imagen guardada como: " << op.output_file << "\n";
+    return ok ? 0 : 1;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Uso: " << argv[0] << " <imagen.jpg> [salida.jpg] [brillo]\n";
-        std::cerr << "Ejemplos:\n";
-        std::cerr << "  " << argv[0] << " entrada.jpg\n";
-        std::cerr << "  " << argv[0] << " entrada.jpg salida.jpg 1.5\n";
-        std::cerr << "  " << argv[0] << " entrada.jpg salida.jpg 0.8\n";
+    Opciones op;
+    if (!parse_args(argc, argv, op)) {
+        mostrar_uso(argv[0]);
         return 1;
     }
 
     // Parámetros configurables
-    std::string output_file = "grayscale.jpg";
-    float brightness = 1.0f; // 1.0 = brillo normal
+    std::string output_file = op.output_file;
+    float brightness = op.brightness;
+
+    // Tabla de operaciones de punto: el brillo va primero, salvo que se
+    // fusione en los pesos; después gamma, contraste, niveles y curvas.
+    // Si se decodifica solo la luminancia no hay pesos: el brillo va en la tabla.
+    const bool fusionar = op.fusionar_brillo && !op.decodificar_gris;
+    CadenaPuntos cadena;
+    if (!fusionar) cadena.brillo(brightness);
+    for (const auto& operacion : op.operaciones.pasos()) cadena.agregar(operacion);
+    ParametrosGris parametros = preparar_parametros(
+        op.modo, fusionar ? brightness : 1.0f, cadena.componer());
 
-    // Procesar argumentos
-    if (argc >= 3) output_file = argv[2];
-    if (argc >= 4) brightness = std::stof(argv[3]);
+    RutaSimd ruta = detectar_ruta();
+    if (!op.ruta.empty()) {
+        if (op.ruta == "escalar") ruta = RutaSimd::Escalar;
+        else if (op.ruta == "sse2") ruta = RutaSimd::SSE2;
+        else if (op.ruta == "avx2") ruta = RutaSimd::AVX2;
+        else {
+            std::cerr << "Ruta desconocida: " << op.ruta << "\n";
+            return 1;
+        }
+        if (!ruta_soportada(ruta)) {
+            std::cerr << "La CPU no soporta la ruta " << op.ruta << "\n";
+            return 1;
+        }
+    }
 
     std::cout << "Ajustando brillo con factor: " << brightness << "\n";
     std::cout << "  (0.0 = negro total, 1.0 = normal, 2.0 = doble brillo)\n";
+    if (op.decodificar_gris) {
+        std::cout << "Gris: luminancia del decodificador (Y de JPEG, BT.601)\n";
+    } else {
+        std::cout << "Gris: " << nombre_modo(op.modo)
+                  << (fusionar ? ", brillo fusionado en los pesos" : "") << "\n";
+    }
+    std::cout << "Operaciones de punto: " << cadena.size() << " en una tabla de 256 entradas"
+              << (parametros.usar_lut ? "" : " (identidad, se omite)") << "\n";
+
+    if (op.lote) {
+        return ejecutar_lote(op, parametros, ruta);
+    }
+
+    if (op.comparar_carga) {
+        return comparar_carga(op);
+    }
+
+    // Los hilos se crean antes de medir para no contar su arranque
+    PoolHilos pool(op.hilos);
+
+    if (op.streaming) {
+        return ejecutar_streaming(op, parametros, ruta, pool);
+    }
 
     // Iniciar temporización
     auto start = std::chrono::high_resolution_clock::now();
 
-    // Cargar imagen (forzar 3 canales RGB)
+    // Cargar imagen: 3 canales RGB, o solo la luminancia con --decodificar-gris
+    // (en un JPEG YCbCr stb se salta entonces la IDCT de Cb/Cr, el
+    // sobremuestreo del croma y la conversión a RGB)
     int width, height, orig_channels;
-    unsigned char* img = stbi_load(argv[1], &width, &height, &orig_channels, 3);
+    const int canales = op.decodificar_gris ? 1 : 3;
+    unsigned char* img = nullptr;
+    FicheroMapeado mapeo;
+    auto map_time = start;
+    if (op.mmap) {
+        if (!mapeo.abrir(op.input_file)) {
+            std::cerr << "Error proyectando " << op.input_file << ": " << mapeo.error() << "\n";
+            return 1;
+        }
+        map_time = std::chrono::high_resolution_clock::now();
+        img = stbi_load_from_memory(mapeo.datos(), static_cast<int>(mapeo.size()),
+                                    &width, &height, &orig_channels, canales);
+    } else {
+        img = stbi_load(op.input_file.c_str(), &width, &height, &orig_channels, canales);
+    }
     auto load_time = std::chrono::high_resolution_clock::now();
     
     if (!img) {
@@ -49,51 +809,216 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Crear buffer para escala de grises
-    std::vector<unsigned char> gray_img(width * height);
+    if (op.benchmark) {
+        benchmark_rutas(img, width, height, parametros);
+        stbi_image_free(img);
+        return 0;
+    }
+
+    if (!op.trabajo.empty()) {
+        int codigo = ejecutar_trabajo(op, pool, img, canales, width, height, parametros, cadena, ruta,
+                                      std::chrono::duration<double, std::milli>(load_time - start).count());
+        stbi_image_free(img);
+        return codigo;
+    }
+
+    // Crear buffer para escala de grises (en modo en sitio o con la
+    // luminancia ya decodificada se reutiliza img)
+    const bool reutilizar_img = op.en_sitio || op.decodificar_gris;
+    BufferPool gray_img = reutilizar_img ? nullptr : reservar_buffer(static_cast<size_t>(width) * height);
     
-    // Convertir a escala de grises con ajuste de brillo
-    for (int i = 0; i < width * height; ++i) {
-        const int offset = i * 3;
-        
-        // Calcular valor de gris (promedio RGB)
-        unsigned char gray_value = static_cast<unsigned char>(
-            (img[offset] +     // R
-             img[offset + 1] + // G
-             img[offset + 2])  // B
-            / 3
-        );
-        
-        // Aplicar ajuste de brillo
-        gray_img[i] = adjust_brightness(gray_value, brightness);
+    // Convertir a escala de grises con ajuste de brillo. Con --auto la primera
+    // pasada convierte sin tabla y cuenta una muestra de filas; la tabla de la
+    // cadena y la del ajuste se componen y se aplican juntas en una segunda
+    // pasada, que cuenta el histograma exacto si hay que volcarlo.
+    const bool ajustar = op.ajuste_auto != AjusteAuto::Ninguno;
+    const bool volcar = !op.histograma.empty();
+    ParametrosGris primera = parametros;
+    if (ajustar) primera.usar_lut = false;
+    Histograma histograma{};
+    Histograma* contar = ajustar || volcar ? &histograma : nullptr;
+    const int paso_filas = ajustar ? MUESTREO_AUTO : 1;
+    std::vector<Banda> bandas = op.decodificar_gris
+        ? aplicar_lut_bandas(pool, img, width, height, primera, ruta, contar, paso_filas)
+        : op.en_sitio
+        ? convertir_gris_en_sitio(pool, img, width, height, primera, ruta, contar, paso_filas)
+        : convertir_gris_bandas(pool, img, gray_img.get(), width, height, primera, ruta, contar, paso_filas);
+    unsigned char* gray = reutilizar_img ? img : gray_img.get();
+    auto pasada_time = std::chrono::high_resolution_clock::now();
+
+    int negro = 0, blanco = 255;
+    if (ajustar) {
+        const Histograma tras_cadena = transformar_histograma(histograma, parametros.lut);
+        const Lut ajuste = op.ajuste_auto == AjusteAuto::Niveles
+            ? lut_auto_niveles(tras_cadena, op.recorte, negro, blanco)
+            : lut_ecualizacion(tras_cadena);
+        ParametrosGris segunda = parametros;
+        for (int v = 0; v < 256; ++v) segunda.lut[v] = ajuste[parametros.lut[v]];
+        segunda.usar_lut = !es_identidad(segunda.lut);
+        aplicar_lut_bandas(pool, gray, width, height, segunda, ruta, volcar ? &histograma : nullptr);
     }
     auto convert_time = std::chrono::high_resolution_clock::now();
 
-    // Guardar imagen en escala de grises
-    int success = stbi_write_jpg(output_file.c_str(), width, height, 1, gray_img.data(), 90);
+    // Filtros de convolución en orden, alternando entre gray y un buffer auxiliar
+    BufferPool auxiliar = op.filtros.empty() ? nullptr : reservar_buffer(static_cast<size_t>(width) * height);
+    unsigned char* otro = auxiliar.get();
+    std::vector<double> ms_filtros;
+    for (const Filtro& filtro : op.filtros) {
+        auto inicio = std::chrono::high_resolution_clock::now();
+        aplicar_filtro(pool, gray, otro, width, height, filtro, ruta);
+        auto fin = std::chrono::high_resolution_clock::now();
+        ms_filtros.push_back(std::chrono::duration<double, std::milli>(fin - inicio).count());
+        std::swap(gray, otro);
+    }
+    // Los filtros cambian los niveles: el histograma volcado es el de la salida
+    if (!op.filtros.empty() && !op.histograma.empty()) {
+        histograma = histograma_paralelo(pool, gray, static_cast<size_t>(width) * height);
+    }
+    auto filter_time = std::chrono::high_resolution_clock::now();
+
+    // Huellas de la imagen que se guarda, para deduplicar en la ingesta
+    Huellas huellas;
+    double ms_huellas = 0.0;
+    if (op.huellas) {
+        auto inicio = std::chrono::high_resolution_clock::now();
+        huellas = calcular_huellas(gray, width, height, ruta);
+        ms_huellas = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - inicio).count();
+    }
+    filter_time = std::chrono::high_resolution_clock::now();
+
+    // Guardar imagen en escala de grises: JPEG (por defecto en paralelo, con
+    // marcadores de reinicio) o PGM/crudo directamente desde el buffer
+    ModoEscritura escritura = op.escritura;
+    auto guardar = [&](const std::string& destino, const unsigned char* datos, int ancho, int alto) {
+        if (op.formato != FormatoSalida::Jpeg) return guardar_crudo(destino, datos, ancho, alto, op.formato, escritura);
+        return op.guardar_stb
+            ? stbi_write_jpg(destino.c_str(), ancho, alto, 1, datos, 90) != 0
+            : guardar_jpeg_gris_paralelo(destino, datos, ancho, alto, 90, pool);
+    };
+    bool success = guardar(output_file, gray, width, height);
     auto save_time = std::chrono::high_resolution_clock::now();
 
     if (!success) {
         std::cerr << "Error guardando la imagen: " << output_file << "\n";
     }
 
+    // Miniaturas a partir del mismo gris, sin volver a decodificar
+    struct Miniatura {
+        int ancho, alto;
+        double ms_escala, ms_guardado;
+        std::string ruta;
+    };
+    std::vector<Miniatura> miniaturas;
+    for (auto [ancho, alto] : op.miniaturas) {
+        if (alto == 0) alto = std::max(1, static_cast<int>(std::lround(static_cast<double>(height) * ancho / width)));
+        Miniatura m{ancho, alto, 0.0, 0.0, ruta_miniatura(output_file, ancho, alto)};
+        BufferPool pequena = reservar_buffer(static_cast<size_t>(ancho) * alto);
+        auto t0 = std::chrono::high_resolution_clock::now();
+        redimensionar(pool, gray, width, height, pequena.get(), ancho, alto, op.filtro_escala, ruta);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        bool ok = guardar(m.ruta, pequena.get(), ancho, alto);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (!ok) std::cerr << "Error guardando la miniatura: " << m.ruta << "\n";
+        m.ms_escala = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        m.ms_guardado = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        miniaturas.push_back(m);
+        success = success && ok;
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+
     // Calcular duraciones
     auto load_duration = std::chrono::duration_cast<std::chrono::milliseconds>(load_time - start);
     auto convert_duration = std::chrono::duration_cast<std::chrono::milliseconds>(convert_time - load_time);
-    auto save_duration = std::chrono::duration_cast<std::chrono::milliseconds>(save_time - convert_time);
-    auto total_duration = std::chrono::duration_cast<std::chrono::milliseconds>(save_time - start);
+    auto save_duration = std::chrono::duration_cast<std::chrono::milliseconds>(save_time - filter_time);
+    auto total_duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start);
 
     // Mostrar resultados
     std::cout << "\nResultados:\n";
     std::cout << "  Dimensiones: " << width << " x " << height << " px\n";
-    std::cout << "  Tiempo carga: " << load_duration.count() << " ms\n";
-    std::cout << "  Tiempo conversion: " << convert_duration.count() << " ms\n";
-    std::cout << "  Tiempo guardado: " << save_duration.count() << " ms\n";
+    std::cout << "  Tiempo carga: " << load_duration.count() << " ms";
+    if (op.mmap) {
+        std::cout << " (" << (mapeo.mapeado() ? "mmap " : "lectura ")
+                  << std::chrono::duration<double, std::milli>(map_time - start).count()
+                  << " ms + decodificacion "
+                  << std::chrono::duration<double, std::milli>(load_time - map_time).count() << " ms)";
+    }
+    std::cout << "\n";
+    double convert_ms = std::chrono::duration<double, std::milli>(convert_time - load_time).count();
+    double megapixeles = static_cast<double>(width) * height / 1e6;
+    std::cout << "  Tiempo conversion: " << convert_duration.count() << " ms ("
+              << nombre_ruta(ruta) << ", " << bandas.size() << " hilos, "
+              << megapixeles / (convert_ms / 1000.0) << " MP/s)\n";
+    for (size_t b = 0; b < bandas.size(); ++b) {
+        double mp_banda = static_cast<double>(bandas[b].fila_fin - bandas[b].fila_inicio) * width / 1e6;
+        std::cout << "    Hilo " << b << ": filas " << bandas[b].fila_inicio << "-"
+                  << bandas[b].fila_fin - 1 << ", " << bandas[b].ms << " ms, "
+                  << mp_banda / (bandas[b].ms / 1000.0) << " MP/s\n";
+    }
+    if (ajustar) {
+        std::cout << "  Ajuste automatico (" << nombre_ajuste(op.ajuste_auto);
+        if (op.ajuste_auto == AjusteAuto::Niveles) std::cout << " " << negro << "-" << blanco;
+        std::cout << "): primera pasada con histograma de 1 fila de cada " << MUESTREO_AUTO << " "
+                  << std::chrono::duration<double, std::milli>(pasada_time - load_time).count()
+                  << " ms, segunda pasada "
+                  << std::chrono::duration<double, std::milli>(convert_time - pasada_time).count() << " ms\n";
+    }
+    for (size_t f = 0; f < op.filtros.size(); ++f) {
+        const Filtro& filtro = op.filtros[f];
+        std::cout << "  Filtro " << nombre_filtro(filtro.tipo);
+        if (filtro.tipo != TipoFiltro::Sobel) std::cout << " (sigma " << filtro.sigma;
+        if (filtro.tipo == TipoFiltro::Enfoque) std::cout << ", cantidad " << filtro.cantidad;
+        if (filtro.tipo != TipoFiltro::Sobel) std::cout << ")";
+        std::cout << ": " << ms_filtros[f] << " ms (" << ms_filtros[f] / megapixeles << " ms/MP)\n";
+    }
+    std::cout << "  Tiempo guardado: " << save_duration.count() << " ms (";
+    if (op.formato != FormatoSalida::Jpeg) {
+        double save_s = std::chrono::duration<double>(save_time - filter_time).count();
+        std::cout << nombre_formato(op.formato) << ", escritura " << nombre_escritura(escritura) << ", "
+                  << (save_s > 0 ? megapixeles / save_s : 0.0) << " MB/s";
+    } else {
+        std::cout << (op.guardar_stb ? "stb, 1 hilo" : "paralelo, " + std::to_string(pool.size()) + " hilos");
+    }
+    std::cout << ")\n";
+    for (const Miniatura& m : miniaturas) {
+        std::cout << "  Miniatura " << m.ancho << "x" << m.alto << " (" << nombre_filtro_escala(op.filtro_escala)
+                  << "): escala " << m.ms_escala << " ms, guardado " << m.ms_guardado << " ms -> " << m.ruta << "\n";
+    }
     std::cout << "  Tiempo total: " << total_duration.count() << " ms\n";
-    std::cout << "  Imagen guardada como: " << output_file << "\n";
+    std::cout << "  Memoria pico (RSS): " << bytes_a_mb(memoria_pico_bytes()) << " MB\n";
+    mostrar_estadisticas_buffers();
+    if (op.en_sitio) {
+        std::cout << "  Memoria ahorrada (en sitio, sin gray_img): "
+                  << bytes_a_mb(static_cast<size_t>(width) * height) << " MB\n";
+    }
+    if (op.huellas) {
+        const std::string ruta_hash = ruta_huellas(output_file);
+        std::cout << "  Huellas: ahash " << huella_hex(huellas.ahash) << ", dhash " << huella_hex(huellas.dhash)
+                  << ", phash " << huella_hex(huellas.phash) << " (" << ms_huellas << " ms, "
+                  << 100.0 * ms_huellas / convert_ms << " % de la conversion)";
+        if (escribir_huellas(ruta_hash, huellas)) {
+            std::cout << " -> " << ruta_hash << "\n";
+        } else {
+            std::cout << "\n";
+            std::cerr << "Error escribiendo las huellas: " << ruta_hash << "\n";
+            success = false;
+        }
+    }
+    if (!op.histograma.empty()) {
+        std::cout << "  Histograma: media "
+                  << media_histograma(histograma) << ", p1 " << nivel_percentil(histograma, 0.01)
+                  << ", p50 " << nivel_percentil(histograma, 0.5) << ", p99 " << nivel_percentil(histograma, 0.99);
+        if (escribir_histograma(op.histograma, histograma)) {
+            std::cout << " -> " << op.histograma << "\n";
+        } else {
+            std::cout << "\n";
+            std::cerr << "Error escribiendo el histograma: " << op.histograma << "\n";
+            success = false;
+        }
+    }
+    if (success) std::cout << "  Imagen guardada como: " << output_file << "\n";
 
     // Liberar memoria
     stbi_image_free(img);
     
-    return 0;
+    return success ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,316 @@
+// 002-benchmark.cpp - Benchmark de las etapas del conversor a gris
+//
+// Genera imágenes sintéticas de varios tamaños y mide por separado cada etapa
+// (decodificar, convertir, codificar), con calentamiento y muchas repeticiones.
+// Informa mediana, mínimo y desviación típica en nanosegundos por píxel y
+// puede escribir los resultados en JSON para comparar entre commits.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include "conversion_gris.h"
+#include "convolucion.h"
+#include "jpeg_gris.h"
+#include "pool_hilos.h"
+#include "redimension.h"
+#include "histograma.h"
+
+// Mayor imagen sintética que acepta --tamanos: mantiene el ancho en int
+constexpr double MAX_MEGAPIXELES = 1000.0;
+
+struct OpcionesBench {
+    std::vector<double> megapixeles = {0.25, 1.0, 4.0, 16.0};
+    int repeticiones = 15;
+    int calentamiento = 3;
+    int calidad = 90;
+    ModoGris modo = ModoGris::Promedio;
+    std::string json;       // vacío = no escribir JSON
+    std::string etiqueta;   // p. ej. el hash del commit
+};
+
+// Tiempos de una etapa para un tamaño de imagen
+struct Medida {
+    std::string etapa;
+    std::string variante;
+    int width = 0;
+    int height = 0;
+    double mediana_ns = 0.0;   // ns por píxel
+    double min_ns = 0.0;
+    double desviacion_ns = 0.0;
+};
+
+void mostrar_uso(const char* programa) {
+    std::cerr << "Uso: " << programa << " [opciones]\n";
+    std::cerr << "Opciones:\n";
+    std::cerr << "  --tamanos 0.25,1,4,16      Megapixeles de las imagenes sinteticas\n";
+    std::cerr << "  --repeticiones N           Repeticiones medidas por etapa (por defecto: 15)\n";
+    std::cerr << "  --calentamiento N          Repeticiones descartadas antes de medir (por defecto: 3)\n";
+    std::cerr << "  --calidad Q                Calidad JPEG de codificacion (por defecto: 90)\n";
+    std::cerr << "  --luma promedio|bt601|bt709  Pesos RGB del gris\n";
+    std::cerr << "  --json fichero.json        Escribir los resultados en JSON\n";
+    std::cerr << "  --etiqueta texto           Identificador de la ejecucion (commit, maquina...)\n";
+}
+
+bool parse_args(int argc, char* argv[], OpcionesBench& op) {
+    // std::stod/stoi lanzan con texto no numérico o fuera de rango; argv[i] es
+    // el valor que se estaba leyendo
+    int i = 1;
+    try {
+        for (; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--tamanos" && i + 1 < argc) {
+                op.megapixeles.clear();
+                std::istringstream lista(argv[++i]);
+                std::string valor;
+                while (std::getline(lista, valor, ',')) {
+                    double mp = std::stod(valor);
+                    if (!std::isfinite(mp) || mp <= 0.0 || mp > MAX_MEGAPIXELES) {
+                        std::cerr << "Tamano no valido: " << valor << "\n";
+                        return false;
+                    }
+                    op.megapixeles.push_back(mp);
+                }
+            } else if ((arg == "--repeticiones" || arg == "--calentamiento" || arg == "--calidad") && i + 1 < argc) {
+                int n = std::stoi(argv[++i]);
+                if (n < (arg == "--calentamiento" ? 0 : 1) || (arg == "--calidad" && n > 100)) {
+                    std::cerr << arg << " fuera de rango: " << n << "\n";
+                    return false;
+                }
+                if (arg == "--repeticiones") op.repeticiones = n;
+                else if (arg == "--calentamiento") op.calentamiento = n;
+                else op.calidad = n;
+            } else if (arg == "--luma" && i + 1 < argc) {
+                std::string modo = argv[++i];
+                if (modo == "promedio") op.modo = ModoGris::Promedio;
+                else if (modo == "bt601") op.modo = ModoGris::BT601;
+                else if (modo == "bt709") op.modo = ModoGris::BT709;
+                else {
+                    std::cerr << "Modo de luma desconocido: " << modo << "\n";
+                    return false;
+                }
+            } else if (arg == "--json" && i + 1 < argc) {
+                op.json = argv[++i];
+            } else if (arg == "--etiqueta" && i + 1 < argc) {
+                op.etiqueta = argv[++i];
+            } else {
+                std::cerr << "Opcion desconocida o sin valor: " << arg << "\n";
+                return false;
+            }
+        }
+    } catch (const std::invalid_argument&) {
+        std::cerr << "Valor no numerico: " << argv[i] << "\n";
+        return false;
+    } catch (const std::out_of_range&) {
+        std::cerr << "Valor fuera de rango: " << argv[i] << "\n";
+        return false;
+    }
+    return !op.megapixeles.empty();
+}
+
+// Imagen RGB determinista: degradados suaves, bordes y algo de ruido,
+// para que el JPEG tenga un tamaño parecido al de una foto
+std::vector<unsigned char> imagen_sintetica(int width, int height) {
+    std::vector<unsigned char> rgb(static_cast<size_t>(width) * height * 3);
+    uint32_t semilla = 12345;
+    size_t i = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            semilla = semilla * 1664525u + 1013904223u;
+            int ruido = static_cast<int>(semilla >> 28) - 8;
+            int bloque = ((x / 64) + (y / 64)) % 2 ? 40 : 0;
+            int r = x * 255 / width + bloque + ruido;
+            int g = y * 255 / height + ruido;
+            int b = (x + y) * 255 / (width + height) - bloque + ruido;
+            rgb[i++] = static_cast<unsigned char>(std::clamp(r, 0, 255));
+            rgb[i++] = static_cast<unsigned char>(std::clamp(g, 0, 255));
+            rgb[i++] = static_cast<unsigned char>(std::clamp(b, 0, 255));
+        }
+    }
+    return rgb;
+}
+
+void anadir_bytes(void* contexto, void* datos, int n) {
+    auto* salida = static_cast<std::vector<unsigned char>*>(contexto);
+    auto* bytes = static_cast<unsigned char*>(datos);
+    salida->insert(salida->end(), bytes, bytes + n);
+}
+
+// Ejecuta f calentamiento + repeticiones veces y resume los tiempos medidos
+Medida medir(const std::string& etapa, const std::string& variante, int width, int height,
+             const OpcionesBench& op, const std::function<void()>& f) {
+    for (int r = 0; r < op.calentamiento; ++r) f();
+
+    const double pixeles = static_cast<double>(width) * height;
+    std::vector<double> ns(op.repeticiones);
+    for (double& t : ns) {
+        auto inicio = std::chrono::steady_clock::now();
+        f();
+        auto fin = std::chrono::steady_clock::now();
+        t = std::chrono::duration<double, std::nano>(fin - inicio).count() / pixeles;
+    }
+    std::sort(ns.begin(), ns.end());
+
+    Medida m;
+    m.etapa = etapa;
+    m.variante = variante;
+    m.width = width;
+    m.height = height;
+    m.min_ns = ns.front();
+    const size_t mitad = ns.size() / 2;
+    m.mediana_ns = ns.size() % 2 ? ns[mitad] : (ns[mitad - 1] + ns[mitad]) / 2.0;
+    double media = 0.0;
+    for (double t : ns) media += t;
+    media /= ns.size();
+    double suma = 0.0;
+    for (double t : ns) suma += (t - media) * (t - media);
+    m.desviacion_ns = ns.size() > 1 ? std::sqrt(suma / (ns.size() - 1)) : 0.0;
+    return m;
+}
+
+std::string json_texto(const std::string& s) {
+    std::string r = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') r += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) r += c;
+    }
+    return r + "\"";
+}
+
+bool escribir_json(const std::string& fichero, const OpcionesBench& op, const std::vector<Medida>& medidas) {
+    std::ofstream out(fichero);
+    if (!out) return false;
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"etiqueta\": " << json_texto(op.etiqueta) << ",\n";
+    out << "  \"ruta_detectada\": " << json_texto(nombre_ruta(detectar_ruta())) << ",\n";
+    out << "  \"luma\": " << json_texto(nombre_modo(op.modo)) << ",\n";
+    out << "  \"repeticiones\": " << op.repeticiones << ",\n";
+    out << "  \"calentamiento\": " << op.calentamiento << ",\n";
+    out << "  \"calidad\": " << op.calidad << ",\n";
+    out << "  \"resultados\": [\n";
+    for (size_t i = 0; i < medidas.size(); ++i) {
+        const Medida& m = medidas[i];
+        out << "    {\"etapa\": " << json_texto(m.etapa)
+            << ", \"variante\": " << json_texto(m.variante)
+            << ", \"ancho\": " << m.width << ", \"alto\": " << m.height
+            << ", \"ns_px_mediana\": " << m.mediana_ns
+            << ", \"ns_px_min\": " << m.min_ns
+            << ", \"ns_px_desviacion\": " << m.desviacion_ns << "}"
+            << (i + 1 < medidas.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char* argv[]) {
+    OpcionesBench op;
+    if (!parse_args(argc, argv, op)) {
+        mostrar_uso(argv[0]);
+        return 1;
+    }
+
+    const ParametrosGris parametros = preparar_parametros(op.modo, 1.0f, lut_identidad());
+    std::vector<Medida> medidas;
+    PoolHilos pool;
+
+    std::cout << "Ruta detectada: " << nombre_ruta(detectar_ruta())
+              << ", luma " << nombre_modo(op.modo)
+              << ", " << op.calentamiento << " + " << op.repeticiones << " repeticiones\n";
+    std::cout << std::fixed << std::setprecision(3);
+
+    for (double mp : op.megapixeles) {
+        // Proporción 4:3, como la mayoría de cámaras
+        const int width = std::max(8, static_cast<int>(std::lround(std::sqrt(mp * 1e6 * 4.0 / 3.0))));
+        const int height = std::max(8, static_cast<int>(std::lround(width * 3.0 / 4.0)));
+        const size_t n = static_cast<size_t>(width) * height;
+
+        std::vector<unsigned char> rgb = imagen_sintetica(width, height);
+        std::vector<unsigned char> jpeg;
+        stbi_write_jpg_to_func(anadir_bytes, &jpeg, width, height, 3, rgb.data(), op.calidad);
+        std::vector<unsigned char> gray(n);
+        std::vector<unsigned char> salida;
+
+        std::cout << "\n" << width << "x" << height << " (" << n / 1e6 << " MP, JPEG de "
+                  << jpeg.size() / 1024 << " KB)\n";
+        std::cout << "  etapa        variante         mediana     minimo  desviacion  (ns/px)\n";
+        auto informar = [&](const Medida& m) {
+            std::cout << "  " << std::left << std::setw(12) << m.etapa << " " << std::setw(14) << m.variante
+                      << std::right << std::setw(10) << m.mediana_ns << std::setw(11) << m.min_ns
+                      << std::setw(12) << m.desviacion_ns << "\n";
+            medidas.push_back(m);
+        };
+
+        informar(medir("decodificar", "stb", width, height, op, [&] {
+            int w, h, c;
+            unsigned char* img = stbi_load_from_memory(jpeg.data(), static_cast<int>(jpeg.size()), &w, &h, &c, 3);
+            stbi_image_free(img);
+        }));
+
+        for (RutaSimd ruta : {RutaSimd::Escalar, RutaSimd::SSE2, RutaSimd::AVX2}) {
+            if (!ruta_soportada(ruta)) continue;
+            informar(medir("convertir", nombre_ruta(ruta), width, height, op, [&] {
+                convertir_gris(rgb.data(), gray.data(), n, parametros, ruta);
+            }));
+        }
+
+        Histograma histograma{};
+        informar(medir("histograma", "escalar", width, height, op, [&] {
+            histograma.fill(0);
+            acumular_histograma(gray.data(), n, histograma);
+        }));
+
+        std::vector<unsigned char> filtrado(n);
+        for (const Filtro& filtro : {Filtro{TipoFiltro::Desenfoque, 2.0, 1.0}, Filtro{TipoFiltro::Sobel, 1.0, 1.0}}) {
+            for (RutaSimd ruta : {RutaSimd::Escalar, RutaSimd::AVX2}) {
+                if (!ruta_soportada(ruta)) continue;
+                informar(medir(nombre_filtro(filtro.tipo), nombre_ruta(ruta), width, height, op, [&] {
+                    aplicar_filtro(pool, gray.data(), filtrado.data(), width, height, filtro, ruta);
+                }));
+            }
+        }
+
+        // Miniatura Lanczos de 320 px de ancho, el caso más caro de los tres filtros
+        const int ancho_mini = 320, alto_mini = std::max(1, height * ancho_mini / width);
+        std::vector<unsigned char> miniatura(static_cast<size_t>(ancho_mini) * alto_mini);
+        for (RutaSimd ruta : {RutaSimd::Escalar, RutaSimd::AVX2}) {
+            if (!ruta_soportada(ruta)) continue;
+            informar(medir("redimension", nombre_ruta(ruta), width, height, op, [&] {
+                redimensionar(pool, gray.data(), width, height, miniatura.data(), ancho_mini, alto_mini,
+                              FiltroEscala::Lanczos3, ruta);
+            }));
+        }
+
+        informar(medir("codificar", "stb", width, height, op, [&] {
+            salida.clear();
+            stbi_write_jpg_to_func(anadir_bytes, &salida, width, height, 1, gray.data(), op.calidad);
+        }));
+        informar(medir("codificar", "jpeg_gris", width, height, op, [&] {
+            codificar_jpeg_gris(gray.data(), width, height, op.calidad, salida);
+        }));
+        informar(medir("codificar", "jpeg_paralelo", width, height, op, [&] {
+            codificar_jpeg_gris_paralelo(gray.data(), width, height, op.calidad, pool, salida);
+        }));
+    }
+
+    if (!op.json.empty()) {
+        if (!escribir_json(op.json, op, medidas)) {
+            std::cerr << "Error: no se pudo escribir " << op.json << "\n";
+            return 1;
+        }
+        std::cout << "\nResultados en " << op.json << "\n";
+    }
+    return 0;
+}
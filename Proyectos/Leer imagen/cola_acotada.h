@@ -0,0 +1,56 @@
+// cola_acotada.h - Cola FIFO con capacidad máxima para encadenar etapas
+//
+// poner() bloquea mientras la cola está llena, así una etapa rápida no
+// acumula imágenes en memoria. Cuando el productor termina llama a cerrar();
+// sacar() devuelve false cuando la cola está cerrada y vacía.
+#ifndef COLA_ACOTADA_H
+#define COLA_ACOTADA_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+template <class T>
+class ColaAcotada {
+public:
+    explicit ColaAcotada(size_t capacidad) : capacidad_(capacidad == 0 ? 1 : capacidad) {}
+
+    // Devuelve false si la cola ya estaba cerrada
+    bool poner(T elemento) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        no_llena_.wait(lock, [this] { return cerrada_ || datos_.size() < capacidad_; });
+        if (cerrada_) return false;
+        datos_.push_back(std::move(elemento));
+        no_vacia_.notify_one();
+        return true;
+    }
+
+    // Devuelve false cuando la cola está cerrada y no quedan elementos
+    bool sacar(T& elemento) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        no_vacia_.wait(lock, [this] { return cerrada_ || !datos_.empty(); });
+        if (datos_.empty()) return false;
+        elemento = std::move(datos_.front());
+        datos_.pop_front();
+        no_llena_.notify_one();
+        return true;
+    }
+
+    void cerrar() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cerrada_ = true;
+        no_vacia_.notify_all();
+        no_llena_.notify_all();
+    }
+
+private:
+    const size_t capacidad_;
+    std::deque<T> datos_;
+    std::mutex mutex_;
+    std::condition_variable no_vacia_;
+    std::condition_variable no_llena_;
+    bool cerrada_ = false;
+};
+
+#endif // COLA_ACOTADA_H
@@ -0,0 +1,267 @@
+// conversion_gris.h - Núcleo RGB -> gris con ajuste de brillo
+//
+// Tres rutas con resultado idéntico bit a bit:
+//   - Escalar: píxel a píxel
+//   - SSE2:    16 píxeles por iteración
+//   - AVX2:    16 píxeles por iteración con registros de 256 bits
+// La ruta se elige en tiempo de ejecución según la CPU (detectar_ruta).
+//
+// El gris se calcula solo con enteros, en punto fijo de 16 bits:
+//     gris = (wr*R + wg*G + wb*B + redondeo) >> desplazamiento
+// que en SIMD es un pmaddwd por pareja de canales. Los pesos dependen del
+// modo (promedio, BT.601, BT.709) y pueden llevar el brillo ya multiplicado.
+// Después se aplica la tabla de operaciones de punto (operaciones_punto.h):
+// en las rutas SIMD, por bloques que aún están en caché L1.
+#ifndef CONVERSION_GRIS_H
+#define CONVERSION_GRIS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "operaciones_punto.h"
+#include "rutas_simd.h"
+
+// Cómo se combinan R, G y B
+enum class ModoGris {
+    Promedio,   // (R+G+B)/3, el cálculo original
+    BT601,      // 0.299 R + 0.587 G + 0.114 B (SD, JPEG)
+    BT709       // 0.2126 R + 0.7152 G + 0.0722 B (HD, sRGB)
+};
+
+inline const char* nombre_modo(ModoGris modo) {
+    switch (modo) {
+        case ModoGris::BT601: return "bt601";
+        case ModoGris::BT709: return "bt709";
+        default:              return "promedio";
+    }
+}
+
+// Pesos en punto fijo y tabla final listos para el núcleo
+struct ParametrosGris {
+    short peso_r = 0, peso_g = 0, peso_b = 0;
+    short redondeo = 0;          // se suma antes de desplazar
+    int desplazamiento = 0;      // bits fraccionarios de los pesos
+    Lut lut = lut_identidad();   // operaciones de punto tras el gris
+    bool usar_lut = false;       // false si la tabla es la identidad
+};
+
+// Prepara los pesos para un modo, un brillo fusionado en los pesos y una tabla.
+//   - Promedio sin brillo en los pesos (brillo_pesos == 1): pesos 21846/65536,
+//     que dan exactamente floor(suma/3) para suma <= 765, como la división original.
+//   - BT.601 / BT.709: pesos en Q15 redondeados, con suma exacta 32768 para que
+//     el blanco siga siendo 255.
+//   - brillo_pesos != 1: multiplica los pesos por el brillo y usa el mayor
+//     desplazamiento que mantiene cada peso en 16 bits con signo.
+inline ParametrosGris preparar_parametros(ModoGris modo, float brillo_pesos, const Lut& lut) {
+    ParametrosGris p;
+    p.lut = lut;
+    p.usar_lut = !es_identidad(lut);
+    const bool fusionar = brillo_pesos != 1.0f;
+
+    if (modo == ModoGris::Promedio && !fusionar) {
+        p.peso_r = p.peso_g = p.peso_b = 21846;
+        p.desplazamiento = 16;
+        return p;
+    }
+
+    double w[3];
+    switch (modo) {
+        case ModoGris::BT601: w[0] = 0.299;  w[1] = 0.587;  w[2] = 0.114;  break;
+        case ModoGris::BT709: w[0] = 0.2126; w[1] = 0.7152; w[2] = 0.0722; break;
+        default:              w[0] = w[1] = w[2] = 1.0 / 3.0; break;
+    }
+
+    double escala = std::max(0.0, static_cast<double>(brillo_pesos));
+    double mayor = std::max({w[0], w[1], w[2]}) * escala;
+    int bits = 15;
+    while (bits > 0 && mayor * (1 << bits) > 32767.0) --bits;
+
+    long q[3];
+    for (int c = 0; c < 3; ++c) q[c] = std::lround(std::min(w[c] * escala * (1 << bits), 32767.0));
+    if (!fusionar) {
+        // Ajustar el peso mayor para que la suma sea exactamente 1.0
+        int k = static_cast<int>(std::max_element(w, w + 3) - w);
+        q[k] += (1L << bits) - (q[0] + q[1] + q[2]);
+    }
+
+    p.peso_r = static_cast<short>(q[0]);
+    p.peso_g = static_cast<short>(q[1]);
+    p.peso_b = static_cast<short>(q[2]);
+    p.desplazamiento = bits;
+    p.redondeo = static_cast<short>(bits > 0 ? 1 << (bits - 1) : 0);
+    return p;
+}
+
+// Valor de gris de un píxel (suma ponderada en punto fijo)
+inline unsigned char luma_pixel(const unsigned char* px, const ParametrosGris& p) {
+    int y = (p.peso_r * px[0] +   // R
+             p.peso_g * px[1] +   // G
+             p.peso_b * px[2] +   // B
+             p.redondeo) >> p.desplazamiento;
+    return static_cast<unsigned char>(std::min(y, 255));
+}
+
+// Solo el gris, sin tabla (colas de las rutas SIMD)
+inline void luma_escalar(const unsigned char* rgb, unsigned char* gray,
+                         size_t n, const ParametrosGris& p) {
+    for (size_t i = 0; i < n; ++i) gray[i] = luma_pixel(rgb + i * 3, p);
+}
+
+// Ruta escalar: el bucle de referencia, gris y tabla píxel a píxel
+inline void convertir_gris_escalar(const unsigned char* rgb, unsigned char* gray,
+                                   size_t n, const ParametrosGris& p) {
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char gray_value = luma_pixel(rgb + i * 3, p);
+        gray[i] = p.usar_lut ? p.lut[gray_value] : gray_value;
+    }
+}
+
+#ifdef RUTAS_SIMD_X86
+
+// Ruta SSE2: separa 16 píxeles RGB en tres registros R, G, B usando solo
+// unpack (SSE2 no tiene pshufb) y opera en 16/32 bits.
+__attribute__((target("sse2")))
+inline void luma_sse2(const unsigned char* rgb, unsigned char* gray,
+                                size_t n, const ParametrosGris& p) {
+    const __m128i cero = _mm_setzero_si128();
+    const __m128i uno = _mm_set1_epi16(1);
+    const __m128i pesos_rg = _mm_unpacklo_epi16(_mm_set1_epi16(p.peso_r), _mm_set1_epi16(p.peso_g));
+    const __m128i pesos_b1 = _mm_unpacklo_epi16(_mm_set1_epi16(p.peso_b), _mm_set1_epi16(p.redondeo));
+    const __m128i desplazamiento = _mm_cvtsi32_si128(p.desplazamiento);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const unsigned char* src = rgb + i * 3;
+        __m128i t00 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        __m128i t02 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+
+        // Desentrelazado RGBRGB... -> RRR.., GGG.., BBB.. en cuatro rondas
+        __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+        __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+        __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+        __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+        __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+        __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+        __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+        __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+        __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+        __m128i r = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+        __m128i g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+        __m128i b = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+
+        // Parejas (R,G) y (B,1) en 16 bits para pmaddwd: 4 grupos de 4 píxeles
+        const __m128i r16[2] = {_mm_unpacklo_epi8(r, cero), _mm_unpackhi_epi8(r, cero)};
+        const __m128i g16[2] = {_mm_unpacklo_epi8(g, cero), _mm_unpackhi_epi8(g, cero)};
+        const __m128i b16[2] = {_mm_unpacklo_epi8(b, cero), _mm_unpackhi_epi8(b, cero)};
+
+        __m128i res[4];
+        for (int k = 0; k < 4; ++k) {
+            const int h = k / 2;
+            __m128i rg = (k % 2 == 0) ? _mm_unpacklo_epi16(r16[h], g16[h]) : _mm_unpackhi_epi16(r16[h], g16[h]);
+            __m128i b1 = (k % 2 == 0) ? _mm_unpacklo_epi16(b16[h], uno) : _mm_unpackhi_epi16(b16[h], uno);
+            __m128i y = _mm_add_epi32(_mm_madd_epi16(rg, pesos_rg), _mm_madd_epi16(b1, pesos_b1));
+            res[k] = _mm_srl_epi32(y, desplazamiento);
+        }
+
+        // Empaquetado con saturación: recorta a [0, 255]
+        __m128i salida = _mm_packus_epi16(_mm_packs_epi32(res[0], res[1]),
+                                          _mm_packs_epi32(res[2], res[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), salida);
+    }
+
+    luma_escalar(rgb + i * 3, gray + i, n - i, p);
+}
+
+// Máscara pshufb que extrae el canal `canal` (0=R, 1=G, 2=B) del bloque
+// `bloque` (0..2) de 16 bytes; las posiciones que no caen en el bloque quedan a cero.
+__attribute__((target("avx2")))
+inline __m128i mascara_canal(int canal, int bloque) {
+    alignas(16) signed char m[16];
+    for (int i = 0; i < 16; ++i) {
+        int byte = i * 3 + canal - bloque * 16;
+        m[i] = (byte >= 0 && byte < 16) ? static_cast<signed char>(byte) : -1;
+    }
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(m));
+}
+
+// Ruta AVX2: desentrelazado con pshufb y aritmética en registros de 256 bits.
+// unpacklo/hi trabajan por carril de 128 bits, así que los grupos quedan
+// como píxeles {0-3, 8-11} y {4-7, 12-15}; packs_epi32 deshace ese orden.
+__attribute__((target("avx2")))
+inline void luma_avx2(const unsigned char* rgb, unsigned char* gray,
+                                size_t n, const ParametrosGris& p) {
+    __m128i mascaras[3][3];
+    for (int c = 0; c < 3; ++c)
+        for (int b = 0; b < 3; ++b)
+            mascaras[c][b] = mascara_canal(c, b);
+
+    const __m256i uno = _mm256_set1_epi16(1);
+    const __m256i pesos_rg = _mm256_unpacklo_epi16(_mm256_set1_epi16(p.peso_r), _mm256_set1_epi16(p.peso_g));
+    const __m256i pesos_b1 = _mm256_unpacklo_epi16(_mm256_set1_epi16(p.peso_b), _mm256_set1_epi16(p.redondeo));
+    const __m128i desplazamiento = _mm_cvtsi32_si128(p.desplazamiento);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const unsigned char* src = rgb + i * 3;
+        const __m128i bloques[3] = {
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32))
+        };
+
+        __m256i canal16[3];
+        for (int c = 0; c < 3; ++c) {
+            __m128i canal = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(bloques[0], mascaras[c][0]),
+                             _mm_shuffle_epi8(bloques[1], mascaras[c][1])),
+                _mm_shuffle_epi8(bloques[2], mascaras[c][2]));
+            canal16[c] = _mm256_cvtepu8_epi16(canal);
+        }
+
+        __m256i res[2];
+        for (int k = 0; k < 2; ++k) {
+            __m256i rg = k == 0 ? _mm256_unpacklo_epi16(canal16[0], canal16[1])
+                                : _mm256_unpackhi_epi16(canal16[0], canal16[1]);
+            __m256i b1 = k == 0 ? _mm256_unpacklo_epi16(canal16[2], uno)
+                                : _mm256_unpackhi_epi16(canal16[2], uno);
+            __m256i y = _mm256_add_epi32(_mm256_madd_epi16(rg, pesos_rg), _mm256_madd_epi16(b1, pesos_b1));
+            res[k] = _mm256_srl_epi32(y, desplazamiento);
+        }
+
+        __m256i y16 = _mm256_packs_epi32(res[0], res[1]);
+        __m128i salida = _mm_packus_epi16(_mm256_castsi256_si128(y16), _mm256_extracti128_si256(y16, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), salida);
+    }
+
+    luma_escalar(rgb + i * 3, gray + i, n - i, p);
+}
+
+#endif // RUTAS_SIMD_X86
+
+// Píxeles por bloque en las rutas SIMD: el gris del bloque sigue en L1
+// cuando se le aplica la tabla
+constexpr size_t PIXELES_BLOQUE_GRIS = 4096;
+
+// Convierte n píxeles RGB a gris con la ruta indicada
+inline void convertir_gris(const unsigned char* rgb, unsigned char* gray, size_t n,
+                           const ParametrosGris& p, RutaSimd ruta) {
+    if (ruta == RutaSimd::Escalar || !ruta_soportada(ruta)) {
+        convertir_gris_escalar(rgb, gray, n, p);
+        return;
+    }
+    for (size_t i = 0; i < n; i += PIXELES_BLOQUE_GRIS) {
+        const size_t m = std::min(PIXELES_BLOQUE_GRIS, n - i);
+#ifdef RUTAS_SIMD_X86
+        if (ruta == RutaSimd::AVX2) luma_avx2(rgb + i * 3, gray + i, m, p);
+        else luma_sse2(rgb + i * 3, gray + i, m, p);
+#endif
+        if (p.usar_lut) aplicar_lut(gray + i, gray + i, m, p.lut, ruta);
+    }
+}
+
+#endif // CONVERSION_GRIS_H
@@ -0,0 +1,295 @@
+// convolucion.h - Filtros de convolución separables sobre la imagen gris
+//
+// Desenfoque gaussiano, máscara de enfoque (unsharp mask) y bordes de Sobel.
+// Todos se expresan como un núcleo horizontal seguido de uno vertical, en
+// punto fijo de 16 bits:
+//   - la pasada horizontal lee bytes y deja enteros de 16 bits;
+//   - la pasada vertical combina esas filas y deja otra vez 16 bits;
+//   - un remate por filtro convierte el resultado a bytes.
+// La imagen se recorre por teselas (TESELA_ANCHO x TESELA_ALTO) para que las
+// filas intermedias quepan en la caché L2, y las teselas se reparten entre
+// los hilos del pool. Los bordes repiten el píxel más cercano.
+#ifndef CONVOLUCION_H
+#define CONVOLUCION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include "pool_hilos.h"
+#include "rutas_simd.h"
+
+enum class TipoFiltro { Desenfoque, Enfoque, Sobel };
+
+inline const char* nombre_filtro(TipoFiltro tipo) {
+    switch (tipo) {
+        case TipoFiltro::Enfoque: return "enfoque";
+        case TipoFiltro::Sobel:   return "sobel";
+        default:                  return "desenfoque";
+    }
+}
+
+struct Filtro {
+    TipoFiltro tipo = TipoFiltro::Desenfoque;
+    double sigma = 1.0;      // desenfoque y enfoque
+    double cantidad = 1.0;   // enfoque: 0 = nada, 1 = duplicar el detalle (máx. 10)
+};
+
+// Núcleo 1D en punto fijo: y[x] = (sum pesos[t] * e[x - radio + t]) >> desplazamiento.
+// El número de pesos es siempre par (se rellena con un 0) para recorrerlos
+// de dos en dos con pmaddwd.
+struct Nucleo1D {
+    std::vector<short> pesos;
+    int radio = 0;
+    int desplazamiento = 0;
+};
+
+inline Nucleo1D nucleo_fijo(std::initializer_list<short> pesos, int desplazamiento) {
+    Nucleo1D k;
+    k.pesos.assign(pesos);
+    k.radio = static_cast<int>(k.pesos.size()) / 2;
+    if (k.pesos.size() % 2) k.pesos.push_back(0);
+    k.desplazamiento = desplazamiento;
+    return k;
+}
+
+// Gaussiana con pesos en Q14 que suman exactamente 1 << 14
+inline Nucleo1D nucleo_gaussiano(double sigma, int desplazamiento) {
+    Nucleo1D k;
+    k.radio = std::max(1, static_cast<int>(std::ceil(3.0 * sigma)));
+    std::vector<double> g(2 * k.radio + 1);
+    double suma = 0.0;
+    for (int i = -k.radio; i <= k.radio; ++i) suma += g[i + k.radio] = std::exp(-0.5 * i * i / (sigma * sigma));
+    int total = 0;
+    for (double v : g) {
+        k.pesos.push_back(static_cast<short>(std::lround(v / suma * (1 << 14))));
+        total += k.pesos.back();
+    }
+    k.pesos[k.radio] = static_cast<short>(k.pesos[k.radio] + (1 << 14) - total);
+    k.pesos.push_back(0);
+    k.desplazamiento = desplazamiento;
+    return k;
+}
+
+inline short saturar16(int v) {
+    return static_cast<short>(std::clamp(v, -32768, 32767));
+}
+
+// Pasada horizontal: `linea` trae n + pesos - 1 bytes con los bordes ya replicados
+inline void pasada_horizontal_escalar(const unsigned char* linea, short* salida, int n, const Nucleo1D& k) {
+    const int taps = static_cast<int>(k.pesos.size());
+    const int redondeo = k.desplazamiento > 0 ? 1 << (k.desplazamiento - 1) : 0;
+    for (int x = 0; x < n; ++x) {
+        int acc = redondeo;
+        for (int t = 0; t < taps; ++t) acc += k.pesos[t] * linea[x + t];
+        salida[x] = saturar16(acc >> k.desplazamiento);
+    }
+}
+
+// Pasada vertical: filas[t] es la fila t de la ventana del núcleo
+inline void pasada_vertical_escalar(const short* const* filas, short* salida, int n, const Nucleo1D& k) {
+    const int taps = static_cast<int>(k.pesos.size());
+    const int redondeo = k.desplazamiento > 0 ? 1 << (k.desplazamiento - 1) : 0;
+    for (int x = 0; x < n; ++x) {
+        int acc = redondeo;
+        for (int t = 0; t < taps; ++t) acc += k.pesos[t] * filas[t][x];
+        salida[x] = saturar16(acc >> k.desplazamiento);
+    }
+}
+
+#ifdef RUTAS_SIMD_X86
+
+// Pesos consecutivos (t, t+1) empaquetados para pmaddwd
+inline std::vector<int> pares_pesos(const Nucleo1D& k) {
+    std::vector<int> pares;
+    for (size_t t = 0; t < k.pesos.size(); t += 2) {
+        pares.push_back(static_cast<unsigned short>(k.pesos[t]) |
+                        (static_cast<int>(k.pesos[t + 1]) << 16));
+    }
+    return pares;
+}
+
+// 16 píxeles por iteración: los bytes x+t y x+t+1 se entrelazan en 16 bits y
+// pmaddwd suma los dos productos de cada píxel en 32 bits
+__attribute__((target("avx2")))
+inline void pasada_horizontal_avx2(const unsigned char* linea, short* salida, int n, const Nucleo1D& k) {
+    const std::vector<int> pares = pares_pesos(k);
+    const __m256i redondeo = _mm256_set1_epi32(k.desplazamiento > 0 ? 1 << (k.desplazamiento - 1) : 0);
+    const __m128i desplazamiento = _mm_cvtsi32_si128(k.desplazamiento);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i lo = redondeo, hi = redondeo;
+        for (size_t p = 0; p < pares.size(); ++p) {
+            const unsigned char* e = linea + x + 2 * p;
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(e)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(e + 1)));
+            __m256i w = _mm256_set1_epi32(pares[p]);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        lo = _mm256_sra_epi32(lo, desplazamiento);
+        hi = _mm256_sra_epi32(hi, desplazamiento);
+        // unpack y pack trabajan por carriles de 128 bits: el orden se recupera
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(salida + x), _mm256_packs_epi32(lo, hi));
+    }
+    pasada_horizontal_escalar(linea + x, salida + x, n - x, k);
+}
+
+__attribute__((target("avx2")))
+inline void pasada_vertical_avx2(const short* const* filas, short* salida, int n, const Nucleo1D& k) {
+    const std::vector<int> pares = pares_pesos(k);
+    const __m256i redondeo = _mm256_set1_epi32(k.desplazamiento > 0 ? 1 << (k.desplazamiento - 1) : 0);
+    const __m128i desplazamiento = _mm_cvtsi32_si128(k.desplazamiento);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i lo = redondeo, hi = redondeo;
+        for (size_t p = 0; p < pares.size(); ++p) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(filas[2 * p] + x));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(filas[2 * p + 1] + x));
+            __m256i w = _mm256_set1_epi32(pares[p]);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        lo = _mm256_sra_epi32(lo, desplazamiento);
+        hi = _mm256_sra_epi32(hi, desplazamiento);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(salida + x), _mm256_packs_epi32(lo, hi));
+    }
+    const short* resto[256];
+    for (size_t t = 0; t < k.pesos.size(); ++t) resto[t] = filas[t] + x;
+    pasada_vertical_escalar(resto, salida + x, n - x, k);
+}
+
+#endif // RUTAS_SIMD_X86
+
+// Solo hay versión AVX2 de las pasadas: SSE2 usa la ruta escalar
+inline void pasada_horizontal(const unsigned char* linea, short* salida, int n, const Nucleo1D& k, RutaSimd ruta) {
+#ifdef RUTAS_SIMD_X86
+    if (ruta == RutaSimd::AVX2) {
+        pasada_horizontal_avx2(linea, salida, n, k);
+        return;
+    }
+#endif
+    pasada_horizontal_escalar(linea, salida, n, k);
+}
+
+inline void pasada_vertical(const short* const* filas, short* salida, int n, const Nucleo1D& k, RutaSimd ruta) {
+#ifdef RUTAS_SIMD_X86
+    if (ruta == RutaSimd::AVX2) {
+        pasada_vertical_avx2(filas, salida, n, k);
+        return;
+    }
+#endif
+    pasada_vertical_escalar(filas, salida, n, k);
+}
+
+constexpr int TESELA_ANCHO = 512;
+constexpr int TESELA_ALTO = 64;
+constexpr int RADIO_MAXIMO = 127 / 2 - 1;   // hasta 126 pesos por núcleo
+
+// Buffers de trabajo de cada hilo, reutilizados entre teselas
+struct TrabajoTesela {
+    std::vector<unsigned char> linea;
+    std::vector<short> horizontal;
+};
+
+// Convoluciona la tesela [x0, x1) x [y0, y1) de src con kh y después kv;
+// deja el resultado de 16 bits en `resultado` (paso x1 - x0)
+inline void convolucionar_tesela(const unsigned char* src, int width, int height,
+                                 int x0, int x1, int y0, int y1,
+                                 const Nucleo1D& kh, const Nucleo1D& kv,
+                                 short* resultado, TrabajoTesela& tt, RutaSimd ruta) {
+    const int tw = x1 - x0;
+    const int th = y1 - y0;
+    const int taps_h = static_cast<int>(kh.pesos.size());
+    const int taps_v = static_cast<int>(kv.pesos.size());
+    const int filas_h = th + 2 * kv.radio;
+    tt.linea.resize(static_cast<size_t>(tw + taps_h));
+    tt.horizontal.resize(static_cast<size_t>(filas_h) * tw);
+
+    // Columnas de la línea: x0 - radio ... x1 - radio + taps - 1, con bordes repetidos
+    const int primera = x0 - kh.radio;
+    const int longitud = tw + taps_h - 1;
+    const int izquierda = std::clamp(-primera, 0, longitud);
+    const int derecha = std::clamp(primera + longitud - width, 0, longitud - izquierda);
+    for (int j = 0; j < filas_h; ++j) {
+        const unsigned char* fila = src + static_cast<size_t>(std::clamp(y0 - kv.radio + j, 0, height - 1)) * width;
+        std::memset(tt.linea.data(), fila[0], izquierda);
+        std::memcpy(tt.linea.data() + izquierda, fila + primera + izquierda, longitud - izquierda - derecha);
+        std::memset(tt.linea.data() + longitud - derecha, fila[width - 1], derecha);
+        pasada_horizontal(tt.linea.data(), tt.horizontal.data() + static_cast<size_t>(j) * tw, tw, kh, ruta);
+    }
+
+    const short* filas[2 * RADIO_MAXIMO + 2];
+    for (int r = 0; r < th; ++r) {
+        for (int t = 0; t < taps_v; ++t) {
+            // El peso de relleno (0) reutiliza la última fila de la ventana
+            filas[t] = tt.horizontal.data() + static_cast<size_t>(r + std::min(t, 2 * kv.radio)) * tw;
+        }
+        pasada_vertical(filas, resultado + static_cast<size_t>(r) * tw, tw, kv, ruta);
+    }
+}
+
+// Aplica el filtro de src a dst (buffers distintos) repartiendo teselas entre hilos
+inline void aplicar_filtro(PoolHilos& pool, const unsigned char* src, unsigned char* dst,
+                           int width, int height, const Filtro& filtro, RutaSimd ruta) {
+    // Gaussiana: horizontal Q14 -> Q7 (valor * 128), vertical Q14 sobre Q7 -> Q7
+    // Sobel: núcleos enteros sin desplazamiento (|gx|, |gy| <= 1020)
+    const double sigma = std::clamp(filtro.sigma, 0.1, RADIO_MAXIMO / 3.0);
+    const Nucleo1D gauss_h = nucleo_gaussiano(sigma, 7);
+    const Nucleo1D gauss_v = nucleo_gaussiano(sigma, 14);
+    const Nucleo1D derivada = nucleo_fijo({-1, 0, 1}, 0);
+    const Nucleo1D suavizado = nucleo_fijo({1, 2, 1}, 0);
+    const int cantidad_q8 = static_cast<int>(std::lround(std::clamp(filtro.cantidad, 0.0, 10.0) * 256.0));
+
+    const int teselas_x = (width + TESELA_ANCHO - 1) / TESELA_ANCHO;
+    const int teselas_y = (height + TESELA_ALTO - 1) / TESELA_ALTO;
+    pool.paralelo_para(static_cast<size_t>(teselas_x) * teselas_y, [&](size_t i) {
+        thread_local TrabajoTesela tt;
+        thread_local std::vector<short> a, b;
+        const int x0 = static_cast<int>(i % teselas_x) * TESELA_ANCHO;
+        const int y0 = static_cast<int>(i / teselas_x) * TESELA_ALTO;
+        const int x1 = std::min(width, x0 + TESELA_ANCHO);
+        const int y1 = std::min(height, y0 + TESELA_ALTO);
+        const int tw = x1 - x0;
+        a.resize(static_cast<size_t>(tw) * (y1 - y0));
+
+        if (filtro.tipo == TipoFiltro::Sobel) {
+            b.resize(a.size());
+            convolucionar_tesela(src, width, height, x0, x1, y0, y1, derivada, suavizado, a.data(), tt, ruta);
+            convolucionar_tesela(src, width, height, x0, x1, y0, y1, suavizado, derivada, b.data(), tt, ruta);
+        } else {
+            convolucionar_tesela(src, width, height, x0, x1, y0, y1, gauss_h, gauss_v, a.data(), tt, ruta);
+        }
+
+        for (int y = y0; y < y1; ++y) {
+            const short* fa = a.data() + static_cast<size_t>(y - y0) * tw;
+            const short* fb = b.data() + static_cast<size_t>(y - y0) * tw;
+            const unsigned char* origen = src + static_cast<size_t>(y) * width + x0;
+            unsigned char* destino = dst + static_cast<size_t>(y) * width + x0;
+            switch (filtro.tipo) {
+                case TipoFiltro::Desenfoque:
+                    for (int x = 0; x < tw; ++x) destino[x] = static_cast<unsigned char>(std::clamp((fa[x] + 64) >> 7, 0, 255));
+                    break;
+                case TipoFiltro::Enfoque:
+                    // original + cantidad * (original - desenfocado), en Q7 * Q8
+                    for (int x = 0; x < tw; ++x) {
+                        int detalle = origen[x] * 128 - fa[x];
+                        destino[x] = static_cast<unsigned char>(
+                            std::clamp(origen[x] + ((detalle * cantidad_q8 + (1 << 14)) >> 15), 0, 255));
+                    }
+                    break;
+                case TipoFiltro::Sobel:
+                    // Magnitud aproximada (|gx| + |gy|) / 2
+                    for (int x = 0; x < tw; ++x) {
+                        destino[x] = static_cast<unsigned char>(
+                            std::min(255, (std::abs(fa[x]) + std::abs(fb[x]) + 1) >> 1));
+                    }
+                    break;
+            }
+        }
+    });
+}
+
+#endif // CONVOLUCION_H
@@ -0,0 +1,126 @@
+// franjas.h - Lectura de una imagen RGB por franjas de filas
+//
+// Los ficheros PNM binarios (P6 color, P5 gris) se decodifican de verdad por
+// franjas: en memoria solo está la franja pedida. stb_image no tiene una API
+// incremental, así que el resto de formatos se decodifican enteros con
+// stbi_load y las franjas son punteros dentro de ese buffer.
+//
+// Requiere que stb_image.h esté incluido antes.
+#ifndef FRANJAS_H
+#define FRANJAS_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class LectorFranjas {
+public:
+    LectorFranjas() = default;
+    LectorFranjas(const LectorFranjas&) = delete;
+    LectorFranjas& operator=(const LectorFranjas&) = delete;
+
+    ~LectorFranjas() {
+        if (fichero_) std::fclose(fichero_);
+        if (imagen_) stbi_image_free(imagen_);
+    }
+
+    bool abrir(const std::string& ruta) {
+        fichero_ = std::fopen(ruta.c_str(), "rb");
+        if (!fichero_) {
+            error_ = "no se puede abrir el fichero";
+            return false;
+        }
+        int p = std::fgetc(fichero_);
+        int tipo = std::fgetc(fichero_);
+        if (p == 'P' && (tipo == '5' || tipo == '6')) {
+            canales_ = tipo == '6' ? 3 : 1;
+            return leer_cabecera_pnm();
+        }
+
+        // Otro formato: decodificación completa con stb
+        std::fclose(fichero_);
+        fichero_ = nullptr;
+        int orig_channels;
+        imagen_ = stbi_load(ruta.c_str(), &width_, &height_, &orig_channels, 3);
+        if (!imagen_) {
+            error_ = stbi_failure_reason();
+            return false;
+        }
+        return true;
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    const std::string& error() const { return error_; }
+
+    // true si la decodificación también va por franjas (memoria acotada)
+    bool por_franjas() const { return imagen_ == nullptr; }
+
+    // Siguientes n filas en RGB; nullptr si hay un error o no quedan filas
+    const unsigned char* leer(int n) {
+        n = std::min(n, height_ - fila_);
+        if (n <= 0) return nullptr;
+        const size_t w = static_cast<size_t>(width_);
+
+        if (imagen_) {
+            const unsigned char* filas = imagen_ + static_cast<size_t>(fila_) * w * 3;
+            fila_ += n;
+            return filas;
+        }
+
+        franja_.resize(static_cast<size_t>(n) * w * 3);
+        const size_t bytes = static_cast<size_t>(n) * w * canales_;
+        if (std::fread(franja_.data(), 1, bytes, fichero_) != bytes) {
+            error_ = "fichero PNM truncado";
+            return nullptr;
+        }
+        if (canales_ == 1) {
+            // Gris -> RGB, de atrás hacia delante para no pisar la entrada
+            for (size_t i = bytes; i-- > 0;) {
+                franja_[i * 3] = franja_[i * 3 + 1] = franja_[i * 3 + 2] = franja_[i];
+            }
+        }
+        fila_ += n;
+        return franja_.data();
+    }
+
+private:
+    // Cabecera PNM: ancho, alto y valor máximo separados por espacios o comentarios
+    bool leer_cabecera_pnm() {
+        int valores[3];
+        for (int& v : valores) {
+            int c = std::fgetc(fichero_);
+            while (c == '#' || std::isspace(c)) {
+                if (c == '#') while (c != '\n' && c != EOF) c = std::fgetc(fichero_);
+                c = std::fgetc(fichero_);
+            }
+            if (!std::isdigit(c)) {
+                error_ = "cabecera PNM no valida";
+                return false;
+            }
+            v = 0;
+            for (; std::isdigit(c); c = std::fgetc(fichero_)) v = v * 10 + (c - '0');
+            // Tras el valor máximo va exactamente un espacio antes de los píxeles
+        }
+        width_ = valores[0];
+        height_ = valores[1];
+        if (width_ <= 0 || height_ <= 0 || valores[2] != 255) {
+            error_ = "solo se admiten PNM de 8 bits (valor maximo 255)";
+            return false;
+        }
+        return true;
+    }
+
+    std::FILE* fichero_ = nullptr;
+    unsigned char* imagen_ = nullptr;   // imagen completa si no es PNM
+    std::vector<unsigned char> franja_;
+    std::string error_;
+    int width_ = 0;
+    int height_ = 0;
+    int canales_ = 3;
+    int fila_ = 0;
+};
+
+#endif // FRANJAS_H
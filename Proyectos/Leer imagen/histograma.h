@@ -0,0 +1,171 @@
+// histograma.h - Histograma de luminancia y ajustes automáticos
+//
+// El histograma de 256 niveles se acumula por bandas: cada hilo cuenta su
+// tramo en un histograma propio y al final se suman, sin atómicos ni
+// memoria compartida en el bucle caliente. Dentro de un tramo se usan cuatro
+// subhistogramas intercalados para que píxeles consecutivos del mismo nivel
+// no encadenen incrementos sobre el mismo contador.
+//
+// Como una tabla de 256 entradas solo mueve niveles de sitio, el histograma
+// tras aplicar una tabla se obtiene del original sin volver a leer la imagen
+// (transformar_histograma). Así los niveles automáticos y la ecualización se
+// calculan sobre el gris sin tabla y se componen con el resto de operaciones
+// de punto en una única tabla, que se aplica en una segunda pasada.
+#ifndef HISTOGRAMA_H
+#define HISTOGRAMA_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "operaciones_punto.h"
+#include "pool_hilos.h"
+
+using Histograma = std::array<uint64_t, 256>;
+
+enum class AjusteAuto { Ninguno, Niveles, Ecualizar };
+
+inline const char* nombre_ajuste(AjusteAuto a) {
+    switch (a) {
+        case AjusteAuto::Niveles:   return "niveles";
+        case AjusteAuto::Ecualizar: return "ecualizar";
+        default:                    return "ninguno";
+    }
+}
+
+// Suma al histograma h los n bytes de datos
+inline void acumular_histograma(const unsigned char* datos, size_t n, Histograma& h) {
+    // Contadores de 32 bits: bloques de 2^30 para que ninguno desborde
+    constexpr size_t BLOQUE = size_t(1) << 30;
+    for (size_t base = 0; base < n; base += BLOQUE) {
+        const size_t fin = std::min(n, base + BLOQUE);
+        uint32_t c[4][256] = {};
+        size_t i = base;
+        for (; i + 4 <= fin; i += 4) {
+            ++c[0][datos[i]];
+            ++c[1][datos[i + 1]];
+            ++c[2][datos[i + 2]];
+            ++c[3][datos[i + 3]];
+        }
+        for (; i < fin; ++i) ++c[0][datos[i]];
+        for (int v = 0; v < 256; ++v) h[v] += uint64_t(c[0][v]) + c[1][v] + c[2][v] + c[3][v];
+    }
+}
+
+// Histograma de n bytes repartido entre los hilos del pool
+inline Histograma histograma_paralelo(PoolHilos& pool, const unsigned char* datos, size_t n) {
+    const size_t n_bandas = std::max<size_t>(1, std::min<size_t>(pool.size(), n));
+    std::vector<Histograma> parciales(n_bandas, Histograma{});
+    pool.paralelo_para(n_bandas, [&](size_t b) {
+        Histograma local{};
+        const size_t inicio = n * b / n_bandas;
+        const size_t fin = n * (b + 1) / n_bandas;
+        acumular_histograma(datos + inicio, fin - inicio, local);
+        parciales[b] = local;
+    });
+    Histograma total{};
+    for (const Histograma& p : parciales)
+        for (int v = 0; v < 256; ++v) total[v] += p[v];
+    return total;
+}
+
+// Histograma de la imagen tras aplicarle la tabla t
+inline Histograma transformar_histograma(const Histograma& h, const Lut& t) {
+    Histograma r{};
+    for (int v = 0; v < 256; ++v) r[t[v]] += h[v];
+    return r;
+}
+
+inline uint64_t total_histograma(const Histograma& h) {
+    uint64_t total = 0;
+    for (uint64_t c : h) total += c;
+    return total;
+}
+
+// Menor nivel que deja por debajo o en él al menos la fracción p de píxeles
+inline int nivel_percentil(const Histograma& h, double p) {
+    const double objetivo = p * static_cast<double>(total_histograma(h));
+    uint64_t acumulado = 0;
+    for (int v = 0; v < 256; ++v) {
+        acumulado += h[v];
+        if (acumulado > 0 && static_cast<double>(acumulado) >= objetivo) return v;
+    }
+    return 255;
+}
+
+inline double media_histograma(const Histograma& h) {
+    const uint64_t total = total_histograma(h);
+    if (total == 0) return 0.0;
+    double suma = 0.0;
+    for (int v = 0; v < 256; ++v) suma += static_cast<double>(v) * h[v];
+    return suma / total;
+}
+
+// Niveles automáticos: estira [negro, blanco] a [0, 255], donde negro y blanco
+// dejan fuera la fracción `recorte` de píxeles por cada extremo. Devuelve el
+// rango elegido en negro y blanco; si la imagen es plana, la identidad.
+inline Lut lut_auto_niveles(const Histograma& h, double recorte, int& negro, int& blanco) {
+    const uint64_t total = total_histograma(h);
+    const double limite = recorte * static_cast<double>(total);
+    negro = 0;
+    blanco = 255;
+    uint64_t acumulado = 0;
+    for (; negro < 255; ++negro) {
+        acumulado += h[negro];
+        if (static_cast<double>(acumulado) > limite) break;
+    }
+    acumulado = 0;
+    for (; blanco > 0; --blanco) {
+        acumulado += h[blanco];
+        if (static_cast<double>(acumulado) > limite) break;
+    }
+    if (blanco <= negro) {
+        negro = 0;
+        blanco = 255;
+        return lut_identidad();
+    }
+    OperacionPunto niveles;
+    niveles.tipo = OperacionPunto::Tipo::Niveles;
+    niveles.a = negro;
+    niveles.b = blanco;
+    return niveles.tabla();
+}
+
+// Ecualización: cada nivel va a su frecuencia acumulada, reescalada para que
+// el primer nivel presente quede en 0 y el último en 255
+inline Lut lut_ecualizacion(const Histograma& h) {
+    const uint64_t total = total_histograma(h);
+    uint64_t minimo = 0;
+    for (uint64_t c : h) {
+        if (c) {
+            minimo = c;
+            break;
+        }
+    }
+    if (total == minimo) return lut_identidad();   // vacía o de un solo nivel
+
+    Lut t;
+    uint64_t acumulado = 0;
+    for (int v = 0; v < 256; ++v) {
+        acumulado += h[v];
+        const double x = acumulado < minimo ? 0.0
+            : static_cast<double>(acumulado - minimo) * 255.0 / static_cast<double>(total - minimo);
+        t[v] = redondear_pixel(x);
+    }
+    return t;
+}
+
+// Escribe el histograma como CSV "nivel,cuenta" para monitorización
+inline bool escribir_histograma(const std::string& ruta, const Histograma& h) {
+    std::ofstream out(ruta);
+    if (!out) return false;
+    out << "nivel,cuenta\n";
+    for (int v = 0; v < 256; ++v) out << v << "," << h[v] << "\n";
+    return static_cast<bool>(out);
+}
+
+#endif // HISTOGRAMA_H
@@ -0,0 +1,180 @@
+// huella.h - Huellas perceptuales (aHash, dHash, pHash) del gris
+//
+// Las tres parten de una reducción muy pequeña de la imagen:
+//   - aHash: 8x8 medias; bit = celda por encima de la media global.
+//   - dHash: 9x8 medias; bit = celda más clara que su vecina derecha.
+//   - pHash: 32x32 medias, DCT-II y los 8x8 coeficientes de baja frecuencia;
+//            bit = coeficiente por encima de la mediana (sin contar el DC).
+// Dos imágenes son casi iguales si la distancia de Hamming entre sus huellas
+// es pequeña (típicamente <= 10 de 64 bits).
+//
+// Leer la imagen entera costaría más que la propia conversión, así que cada
+// celda promedia solo FILAS_MUESTRA filas repartidas por su alto (completas a
+// lo ancho de la celda). Para 6000x4000 y 32x32 celdas se leen 256 filas de
+// 4000.
+#ifndef HUELLA_H
+#define HUELLA_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "rutas_simd.h"
+
+constexpr int FILAS_MUESTRA = 8;
+
+struct Huellas {
+    uint64_t ahash = 0;
+    uint64_t dhash = 0;
+    uint64_t phash = 0;
+};
+
+inline std::string huella_hex(uint64_t h) {
+    char texto[17];
+    std::snprintf(texto, sizeof(texto), "%016llx", static_cast<unsigned long long>(h));
+    return texto;
+}
+
+inline uint32_t sumar_bytes_escalar(const unsigned char* p, int n) {
+    uint32_t s = 0;
+    for (int i = 0; i < n; ++i) s += p[i];
+    return s;
+}
+
+#ifdef RUTAS_SIMD_X86
+
+// psadbw contra cero suma 8 bytes en cada mitad del registro
+__attribute__((target("sse2")))
+inline uint32_t sumar_bytes_sse2(const unsigned char* p, int n) {
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)),
+                                              _mm_setzero_si128()));
+    }
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(acc)) + sumar_bytes_escalar(p + i, n - i);
+}
+
+#endif // RUTAS_SIMD_X86
+
+// Suma de n bytes; AVX2 usa también la versión SSE2 (las celdas son cortas)
+inline uint32_t sumar_bytes(const unsigned char* p, int n, RutaSimd ruta) {
+#ifdef RUTAS_SIMD_X86
+    if (ruta != RutaSimd::Escalar) return sumar_bytes_sse2(p, n);
+#endif
+    return sumar_bytes_escalar(p, n);
+}
+
+// Media de cada celda de una rejilla ancho x alto sobre gray (width x height)
+inline std::vector<float> reducir_celdas(const unsigned char* gray, int width, int height, int ancho, int alto,
+                                         RutaSimd ruta) {
+    std::vector<int> borde_x(ancho + 1);
+    for (int c = 0; c <= ancho; ++c) borde_x[c] = static_cast<int>(static_cast<long long>(width) * c / ancho);
+
+    std::vector<float> celdas(static_cast<size_t>(ancho) * alto);
+    std::vector<uint32_t> sumas(ancho);
+    for (int f = 0; f < alto; ++f) {
+        const int y0 = static_cast<int>(static_cast<long long>(height) * f / alto);
+        const int y1 = std::max(y0 + 1, static_cast<int>(static_cast<long long>(height) * (f + 1) / alto));
+        const int filas = std::min(FILAS_MUESTRA, y1 - y0);
+        std::fill(sumas.begin(), sumas.end(), 0);
+        for (int m = 0; m < filas; ++m) {
+            // Filas centradas en FILAS_MUESTRA franjas iguales de la celda
+            const int y = y0 + static_cast<int>((2LL * m + 1) * (y1 - y0) / (2 * filas));
+            const unsigned char* fila = gray + static_cast<size_t>(y) * width;
+            for (int c = 0; c < ancho; ++c) sumas[c] += sumar_bytes(fila + borde_x[c], borde_x[c + 1] - borde_x[c], ruta);
+        }
+        for (int c = 0; c < ancho; ++c) {
+            const int pixeles = std::max(1, borde_x[c + 1] - borde_x[c]) * filas;
+            celdas[static_cast<size_t>(f) * ancho + c] = static_cast<float>(sumas[c]) / pixeles;
+        }
+    }
+    return celdas;
+}
+
+inline uint64_t calcular_ahash(const std::vector<float>& celdas8x8) {
+    float media = 0.0f;
+    for (float v : celdas8x8) media += v;
+    media /= 64.0f;
+    uint64_t h = 0;
+    for (int i = 0; i < 64; ++i) h = (h << 1) | (celdas8x8[i] > media);
+    return h;
+}
+
+inline uint64_t calcular_dhash(const std::vector<float>& celdas9x8) {
+    uint64_t h = 0;
+    for (int f = 0; f < 8; ++f)
+        for (int c = 0; c < 8; ++c) h = (h << 1) | (celdas9x8[f * 9 + c] > celdas9x8[f * 9 + c + 1]);
+    return h;
+}
+
+// DCT-II separable de 32x32, solo las 8 frecuencias más bajas por eje
+inline uint64_t calcular_phash(const std::vector<float>& celdas32x32) {
+    constexpr int N = 32, K = 8;
+    constexpr double PI = 3.14159265358979323846;   // M_PI no es estándar (MSVC)
+    static const std::vector<float> cosenos = [] {
+        std::vector<float> c(K * N);
+        for (int k = 0; k < K; ++k)
+            for (int n = 0; n < N; ++n) c[k * N + n] = static_cast<float>(std::cos(PI * (2 * n + 1) * k / (2.0 * N)));
+        return c;
+    }();
+
+    float filas[N][K];   // DCT de cada fila
+    for (int y = 0; y < N; ++y)
+        for (int k = 0; k < K; ++k) {
+            float s = 0.0f;
+            for (int x = 0; x < N; ++x) s += celdas32x32[y * N + x] * cosenos[k * N + x];
+            filas[y][k] = s;
+        }
+    float coef[K * K];
+    for (int ky = 0; ky < K; ++ky)
+        for (int kx = 0; kx < K; ++kx) {
+            float s = 0.0f;
+            for (int y = 0; y < N; ++y) s += filas[y][kx] * cosenos[ky * N + y];
+            coef[ky * K + kx] = s;
+        }
+
+    // Mediana sin el DC, que solo refleja el brillo medio
+    std::vector<float> ordenados(coef + 1, coef + K * K);
+    std::nth_element(ordenados.begin(), ordenados.begin() + ordenados.size() / 2, ordenados.end());
+    const float mediana = ordenados[ordenados.size() / 2];
+    uint64_t h = 0;
+    for (int i = 0; i < K * K; ++i) h = (h << 1) | (coef[i] > mediana);
+    return h;
+}
+
+inline Huellas calcular_huellas(const unsigned char* gray, int width, int height, RutaSimd ruta) {
+    Huellas h;
+    const std::vector<float> c32 = reducir_celdas(gray, width, height, 32, 32, ruta);
+    std::vector<float> c8(64, 0.0f);   // 8x8 = bloques de 4x4 celdas de la rejilla de 32
+    for (int y = 0; y < 32; ++y)
+        for (int x = 0; x < 32; ++x) c8[(y / 4) * 8 + x / 4] += c32[y * 32 + x] / 16.0f;
+    h.ahash = calcular_ahash(c8);
+    h.dhash = calcular_dhash(reducir_celdas(gray, width, height, 9, 8, ruta));
+    h.phash = calcular_phash(c32);
+    return h;
+}
+
+// Fichero de huellas junto a la salida: salida.jpg -> salida.hash
+inline std::string ruta_huellas(const std::string& salida) {
+    const size_t barra = salida.find_last_of("/\\");
+    const size_t punto = salida.find_last_of('.');
+    if (punto == std::string::npos || (barra != std::string::npos && punto < barra)) return salida + ".hash";
+    return salida.substr(0, punto) + ".hash";
+}
+
+inline bool escribir_huellas(const std::string& ruta, const Huellas& h) {
+    std::ofstream out(ruta);
+    if (!out) return false;
+    out << "ahash " << huella_hex(h.ahash) << "\n"
+        << "dhash " << huella_hex(h.dhash) << "\n"
+        << "phash " << huella_hex(h.phash) << "\n";
+    return static_cast<bool>(out);
+}
+
+#endif // HUELLA_H
@@ -0,0 +1,456 @@
+// jpeg_gris.h - Codificador JPEG baseline de un solo canal (gris)
+//
+// stbi_write_jpg necesita la imagen entera en memoria y, aunque la entrada
+// sea gris, escribe tres componentes. Este codificador escribe un JPEG de
+// una componente y recibe las filas por franjas: codifica cada fila de
+// bloques 8x8 en cuanto está completa, así que solo guarda 8 filas pendientes.
+//
+// Usa la misma DCT flotante (AAN), las mismas tablas de cuantización
+// escaladas por calidad y las tablas Huffman estándar (anexo K) que stb.
+// Con la imagen entera en memoria, codificar_jpeg_gris_paralelo reparte las
+// filas de bloques entre hilos separándolas con marcadores de reinicio.
+#ifndef JPEG_GRIS_H
+#define JPEG_GRIS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "pool_hilos.h"
+
+// Orden zigzag: posición natural -> posición en zigzag
+static const unsigned char JPEG_ZIGZAG[64] = {
+    0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
+    3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+    10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+    21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63
+};
+
+static const unsigned char JPEG_DC_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const unsigned char JPEG_DC_VALORES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const unsigned char JPEG_AC_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const unsigned char JPEG_AC_VALORES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Tabla de cuantización de luminancia (orden natural)
+static const int JPEG_LUMA_QT[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+
+// Código Huffman: bits y longitud
+struct CodigoHuffman {
+    uint16_t bits = 0;
+    uint8_t longitud = 0;
+};
+
+// Tablas derivadas de la calidad, compartidas por todos los bloques
+struct TablasJpeg {
+    unsigned char cuantizacion[64];   // en orden zigzag, tal como va en DQT
+    float divisores[64];              // 1 / (q * escala AAN), orden natural
+    CodigoHuffman dc[12];
+    CodigoHuffman ac[256];
+
+    explicit TablasJpeg(int calidad) {
+        calidad = std::clamp(calidad, 1, 100);
+        int escala = calidad < 50 ? 5000 / calidad : 200 - calidad * 2;
+        for (int i = 0; i < 64; ++i) {
+            int q = (JPEG_LUMA_QT[i] * escala + 50) / 100;
+            cuantizacion[JPEG_ZIGZAG[i]] = static_cast<unsigned char>(std::clamp(q, 1, 255));
+        }
+        static const float aan[8] = {
+            1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f,
+            1.175875602f * 2.828427125f, 1.0f * 2.828427125f, 0.785694958f * 2.828427125f,
+            0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f
+        };
+        for (int fila = 0, k = 0; fila < 8; ++fila)
+            for (int col = 0; col < 8; ++col, ++k)
+                divisores[k] = 1.0f / (cuantizacion[JPEG_ZIGZAG[k]] * aan[fila] * aan[col]);
+
+        construir_huffman(JPEG_DC_BITS, JPEG_DC_VALORES, dc);
+        construir_huffman(JPEG_AC_BITS, JPEG_AC_VALORES, ac);
+    }
+
+private:
+    // Códigos canónicos a partir del número de códigos por longitud
+    static void construir_huffman(const unsigned char* bits, const unsigned char* valores,
+                                  CodigoHuffman* tabla) {
+        uint16_t codigo = 0;
+        int k = 0;
+        for (int longitud = 1; longitud <= 16; ++longitud) {
+            for (int i = 0; i < bits[longitud - 1]; ++i, ++k) {
+                tabla[valores[k]].bits = codigo++;
+                tabla[valores[k]].longitud = static_cast<uint8_t>(longitud);
+            }
+            codigo <<= 1;
+        }
+    }
+};
+
+// Escribe bits en un buffer de bytes con el relleno 0xFF 0x00 que exige JPEG
+class EscritorBits {
+public:
+    explicit EscritorBits(std::vector<unsigned char>& salida) : salida_(salida) {}
+
+    void poner(uint32_t bits, int longitud) {
+        acumulador_ = (acumulador_ << longitud) | (bits & ((1u << longitud) - 1));
+        n_bits_ += longitud;
+        while (n_bits_ >= 8) {
+            unsigned char c = static_cast<unsigned char>(acumulador_ >> (n_bits_ - 8));
+            salida_.push_back(c);
+            if (c == 0xFF) salida_.push_back(0);
+            n_bits_ -= 8;
+        }
+        acumulador_ &= (1u << n_bits_) - 1;
+    }
+
+    // Completa el último byte con unos
+    void alinear() {
+        if (n_bits_ > 0) poner((1u << (8 - n_bits_)) - 1, 8 - n_bits_);
+    }
+
+private:
+    std::vector<unsigned char>& salida_;
+    uint32_t acumulador_ = 0;
+    int n_bits_ = 0;
+};
+
+// DCT flotante AAN de 8 puntos sobre d[0], d[paso], ..., d[7*paso]
+inline void jpeg_dct8(float* d, int paso) {
+    float tmp0 = d[0] + d[7 * paso], tmp7 = d[0] - d[7 * paso];
+    float tmp1 = d[paso] + d[6 * paso], tmp6 = d[paso] - d[6 * paso];
+    float tmp2 = d[2 * paso] + d[5 * paso], tmp5 = d[2 * paso] - d[5 * paso];
+    float tmp3 = d[3 * paso] + d[4 * paso], tmp4 = d[3 * paso] - d[4 * paso];
+
+    // Parte par
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    d[0] = tmp10 + tmp11;
+    d[4 * paso] = tmp10 - tmp11;
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * paso] = tmp13 + z1;
+    d[6 * paso] = tmp13 - z1;
+
+    // Parte impar
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    float z5 = (tmp10 - tmp12) * 0.382683433f;
+    float z2 = tmp10 * 0.541196100f + z5;
+    float z4 = tmp12 * 1.306562965f + z5;
+    float z3 = tmp11 * 0.707106781f;
+    float z11 = tmp7 + z3, z13 = tmp7 - z3;
+    d[5 * paso] = z13 + z2;
+    d[3 * paso] = z13 - z2;
+    d[paso] = z11 + z4;
+    d[7 * paso] = z11 - z4;
+}
+
+// Categoría (número de bits) de un coeficiente y sus bits en complemento a uno
+inline int jpeg_categoria(int v, uint32_t& bits) {
+    int a = v < 0 ? -v : v;
+    int n = 0;
+    while (a) { ++n; a >>= 1; }
+    bits = static_cast<uint32_t>(v < 0 ? v - 1 : v) & ((1u << n) - 1);
+    return n;
+}
+
+// Transforma, cuantiza y codifica un bloque 8x8; devuelve su coeficiente DC
+inline int jpeg_codificar_bloque(float* bloque, const TablasJpeg& t, int dc_anterior, EscritorBits& out) {
+    for (int f = 0; f < 8; ++f) jpeg_dct8(bloque + f * 8, 1);
+    for (int c = 0; c < 8; ++c) jpeg_dct8(bloque + c, 8);
+
+    int zz[64];
+    for (int k = 0; k < 64; ++k) {
+        float v = bloque[k] * t.divisores[k];
+        zz[JPEG_ZIGZAG[k]] = static_cast<int>(v < 0 ? v - 0.5f : v + 0.5f);
+    }
+
+    uint32_t bits;
+    int n = jpeg_categoria(zz[0] - dc_anterior, bits);
+    out.poner(t.dc[n].bits, t.dc[n].longitud);
+    if (n) out.poner(bits, n);
+
+    int ultimo = 63;
+    while (ultimo > 0 && zz[ultimo] == 0) --ultimo;
+    for (int i = 1, ceros = 0; i <= ultimo; ++i) {
+        if (zz[i] == 0) {
+            ++ceros;
+            continue;
+        }
+        for (; ceros >= 16; ceros -= 16) out.poner(t.ac[0xF0].bits, t.ac[0xF0].longitud);
+        n = jpeg_categoria(zz[i], bits);
+        const CodigoHuffman& h = t.ac[(ceros << 4) | n];
+        out.poner(h.bits, h.longitud);
+        out.poner(bits, n);
+        ceros = 0;
+    }
+    if (ultimo != 63) out.poner(t.ac[0x00].bits, t.ac[0x00].longitud);  // EOB
+    return zz[0];
+}
+
+// Codifica una fila de bloques: 8 filas de píxeles (filas[0..validas-1]);
+// las filas y columnas que faltan repiten la última disponible.
+inline void jpeg_codificar_fila_bloques(const unsigned char* filas, size_t paso, int width,
+                                        int validas, const TablasJpeg& t, int& dc,
+                                        EscritorBits& out) {
+    float bloque[64];
+    for (int x0 = 0; x0 < width; x0 += 8) {
+        for (int f = 0; f < 8; ++f) {
+            const unsigned char* fila = filas + std::min(f, validas - 1) * paso;
+            for (int c = 0; c < 8; ++c) {
+                bloque[f * 8 + c] = fila[std::min(x0 + c, width - 1)] - 128.0f;
+            }
+        }
+        dc = jpeg_codificar_bloque(bloque, t, dc, out);
+    }
+}
+
+// Cabecera: SOI, JFIF, DQT, SOF0 (1 componente), DHT, DRI (si hay
+// intervalo de reinicio, en MCUs) y SOS
+inline void jpeg_escribir_cabecera(std::vector<unsigned char>& b, int width, int height,
+                                   const TablasJpeg& t, int intervalo_reinicio = 0) {
+    auto u16 = [&b](int v) {
+        b.push_back(static_cast<unsigned char>(v >> 8));
+        b.push_back(static_cast<unsigned char>(v));
+    };
+    static const unsigned char jfif[] = {0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    b.insert(b.end(), jfif, jfif + sizeof(jfif));
+
+    b.push_back(0xFF); b.push_back(0xDB); u16(67); b.push_back(0);
+    b.insert(b.end(), t.cuantizacion, t.cuantizacion + 64);
+
+    b.push_back(0xFF); b.push_back(0xC0); u16(11); b.push_back(8);
+    u16(height); u16(width);
+    b.push_back(1); b.push_back(1); b.push_back(0x11); b.push_back(0);
+
+    b.push_back(0xFF); b.push_back(0xC4); u16(2 + 17 + 12 + 17 + 162);
+    b.push_back(0x00);
+    b.insert(b.end(), JPEG_DC_BITS, JPEG_DC_BITS + 16);
+    b.insert(b.end(), JPEG_DC_VALORES, JPEG_DC_VALORES + 12);
+    b.push_back(0x10);
+    b.insert(b.end(), JPEG_AC_BITS, JPEG_AC_BITS + 16);
+    b.insert(b.end(), JPEG_AC_VALORES, JPEG_AC_VALORES + 162);
+
+    if (intervalo_reinicio > 0) {
+        b.push_back(0xFF); b.push_back(0xDD); u16(4); u16(intervalo_reinicio);
+    }
+
+    static const unsigned char sos[] = {0xFF, 0xDA, 0, 8, 1, 1, 0x00, 0, 63, 0};
+    b.insert(b.end(), sos, sos + sizeof(sos));
+}
+
+// Codifica una imagen gris completa en memoria (sin fichero)
+inline bool codificar_jpeg_gris(const unsigned char* gray, int width, int height, int calidad,
+                                std::vector<unsigned char>& salida) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+    TablasJpeg tablas(calidad);
+    salida.clear();
+    jpeg_escribir_cabecera(salida, width, height, tablas);
+    EscritorBits bits(salida);
+    const size_t w = static_cast<size_t>(width);
+    int dc = 0;
+    for (int y = 0; y < height; y += 8) {
+        jpeg_codificar_fila_bloques(gray + y * w, w, width, std::min(8, height - y), tablas, dc, bits);
+    }
+    bits.alinear();
+    salida.push_back(0xFF);
+    salida.push_back(0xD9);
+    return true;
+}
+
+// Codificación con marcadores de reinicio. Cada segmento de filas de bloques
+// empieza con la predicción DC a cero y termina alineado a byte, así que los
+// segmentos se codifican por separado y se unen con RST0..RST7. El intervalo
+// DRI cuenta MCUs (aquí un bloque 8x8) y no puede pasar de 65535.
+//
+// Los pasos van por separado (preparar, codificar_segmento, ensamblar) para
+// poder repartir en un mismo paralelo_para los segmentos de varias imágenes.
+class CodificacionJpegSegmentada {
+public:
+    // objetivo_segmentos: cuántos segmentos se buscan (se ajusta al límite DRI)
+    bool preparar(const unsigned char* gray, int width, int height, int calidad, int objetivo_segmentos) {
+        if (width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+        gray_ = gray;
+        width_ = width;
+        height_ = height;
+        bloques_fila_ = (width + 7) / 8;
+        filas_bloques_ = (height + 7) / 8;
+        const int objetivo = std::max(1, objetivo_segmentos);
+        filas_segmento_ = std::clamp((filas_bloques_ + objetivo - 1) / objetivo,
+                                     1, std::max(1, 65535 / bloques_fila_));
+        segmentos_.assign((filas_bloques_ + filas_segmento_ - 1) / filas_segmento_, {});
+        tablas_ = std::make_unique<TablasJpeg>(calidad);
+        return true;
+    }
+
+    size_t segmentos() const { return segmentos_.size(); }
+
+    void codificar_segmento(size_t s) {
+        const size_t w = static_cast<size_t>(width_);
+        std::vector<unsigned char>& seg = segmentos_[s];
+        seg.reserve(static_cast<size_t>(filas_segmento_) * 8 * w / 4);
+        EscritorBits bits(seg);
+        int dc = 0;
+        const int fila_fin = std::min(filas_bloques_, static_cast<int>(s + 1) * filas_segmento_);
+        for (int fb = static_cast<int>(s) * filas_segmento_; fb < fila_fin; ++fb) {
+            const int y = fb * 8;
+            jpeg_codificar_fila_bloques(gray_ + y * w, w, width_, std::min(8, height_ - y), *tablas_, dc, bits);
+        }
+        bits.alinear();
+    }
+
+    void ensamblar(std::vector<unsigned char>& salida) const {
+        const int n_segmentos = static_cast<int>(segmentos_.size());
+        salida.clear();
+        jpeg_escribir_cabecera(salida, width_, height_, *tablas_,
+                               n_segmentos > 1 ? filas_segmento_ * bloques_fila_ : 0);
+        for (int s = 0; s < n_segmentos; ++s) {
+            if (s > 0) {
+                salida.push_back(0xFF);
+                salida.push_back(static_cast<unsigned char>(0xD0 + (s - 1) % 8));
+            }
+            salida.insert(salida.end(), segmentos_[s].begin(), segmentos_[s].end());
+        }
+        salida.push_back(0xFF);
+        salida.push_back(0xD9);
+    }
+
+private:
+    const unsigned char* gray_ = nullptr;
+    int width_ = 0, height_ = 0;
+    int bloques_fila_ = 0, filas_bloques_ = 0, filas_segmento_ = 1;
+    std::unique_ptr<TablasJpeg> tablas_;
+    std::vector<std::vector<unsigned char>> segmentos_;
+};
+
+// Codificación en paralelo: unos 4 segmentos por hilo para repartir bien la carga
+inline bool codificar_jpeg_gris_paralelo(const unsigned char* gray, int width, int height, int calidad,
+                                         PoolHilos& pool, std::vector<unsigned char>& salida) {
+    CodificacionJpegSegmentada jpeg;
+    if (!jpeg.preparar(gray, width, height, calidad, static_cast<int>(pool.size()) * 4)) return false;
+    pool.paralelo_para(jpeg.segmentos(), [&](size_t s) { jpeg.codificar_segmento(s); });
+    jpeg.ensamblar(salida);
+    return true;
+}
+
+// Escribe bytes en un fichero con stdio
+inline bool escribir_fichero(const std::string& ruta, const std::vector<unsigned char>& bytes) {
+    std::FILE* f = std::fopen(ruta.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+// Codifica en paralelo y escribe el fichero
+inline bool guardar_jpeg_gris_paralelo(const std::string& ruta, const unsigned char* gray, int width,
+                                       int height, int calidad, PoolHilos& pool) {
+    std::vector<unsigned char> bytes;
+    if (!codificar_jpeg_gris_paralelo(gray, width, height, calidad, pool, bytes)) return false;
+    return escribir_fichero(ruta, bytes);
+}
+
+// Escritor por franjas: abrir, escribir_filas tantas veces como haga falta
+// (en orden, de arriba abajo) y cerrar
+class EscritorJpegGris {
+public:
+    EscritorJpegGris() = default;
+    EscritorJpegGris(const EscritorJpegGris&) = delete;
+    EscritorJpegGris& operator=(const EscritorJpegGris&) = delete;
+    ~EscritorJpegGris() { if (fichero_) std::fclose(fichero_); }
+
+    bool abrir(const std::string& ruta, int width, int height, int calidad) {
+        if (width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+        fichero_ = std::fopen(ruta.c_str(), "wb");
+        if (!fichero_) return false;
+        width_ = width;
+        height_ = height;
+        tablas_ = std::make_unique<TablasJpeg>(calidad);
+        pendientes_.reserve(static_cast<size_t>(width) * 8);
+        jpeg_escribir_cabecera(buffer_, width, height, *tablas_);
+        return volcar();
+    }
+
+    // Añade n filas consecutivas de `width` bytes
+    bool escribir_filas(const unsigned char* filas, int n) {
+        const size_t w = static_cast<size_t>(width_);
+        while (n > 0) {
+            if (pendientes_.empty() && n >= 8) {
+                // Filas completas: se codifican directamente desde la franja
+                codificar(filas, 8);
+                filas += 8 * w;
+                n -= 8;
+                continue;
+            }
+            int copiar = std::min(n, 8 - static_cast<int>(pendientes_.size() / w));
+            pendientes_.insert(pendientes_.end(), filas, filas + copiar * w);
+            filas += copiar * w;
+            n -= copiar;
+            if (pendientes_.size() == 8 * w) {
+                codificar(pendientes_.data(), 8);
+                pendientes_.clear();
+            }
+        }
+        return volcar();
+    }
+
+    // Codifica las filas que queden, escribe EOI y cierra el fichero
+    bool cerrar() {
+        if (!fichero_) return false;
+        if (!pendientes_.empty()) {
+            codificar(pendientes_.data(), static_cast<int>(pendientes_.size() / width_));
+            pendientes_.clear();
+        }
+        bits_.alinear();
+        buffer_.push_back(0xFF);
+        buffer_.push_back(0xD9);
+        bool ok = volcar() && filas_escritas_ == height_;
+        ok = std::fclose(fichero_) == 0 && ok;
+        fichero_ = nullptr;
+        return ok;
+    }
+
+private:
+    void codificar(const unsigned char* filas, int validas) {
+        validas = std::min(validas, height_ - filas_escritas_);
+        if (validas <= 0) return;
+        jpeg_codificar_fila_bloques(filas, width_, width_, validas, *tablas_, dc_, bits_);
+        filas_escritas_ += validas;
+    }
+
+    bool volcar() {
+        bool ok = buffer_.empty() ||
+                  std::fwrite(buffer_.data(), 1, buffer_.size(), fichero_) == buffer_.size();
+        buffer_.clear();
+        return ok;
+    }
+
+    std::FILE* fichero_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    int filas_escritas_ = 0;
+    int dc_ = 0;
+    std::unique_ptr<TablasJpeg> tablas_;
+    std::vector<unsigned char> pendientes_;  // filas de un bloque incompleto
+    std::vector<unsigned char> buffer_;      // bytes codificados por volcar
+    EscritorBits bits_{buffer_};             // conserva los bits entre llamadas
+};
+
+#endif // JPEG_GRIS_H
@@ -0,0 +1,309 @@
+// lote.h - Modo lote: carga -> conversión -> guardado en tubería
+//
+// Cada etapa tiene su propio grupo de hilos y se comunica con la siguiente
+// mediante una ColaAcotada, así la decodificación, la conversión y la
+// codificación de imágenes distintas se solapan en el tiempo.
+//
+// Requiere que stb_image.h y stb_image_write.h estén incluidos antes.
+#ifndef LOTE_H
+#define LOTE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cola_acotada.h"
+#include "conversion_gris.h"
+#include "huella.h"
+#include "mapeo.h"
+#include "pool_buffers.h"
+#include "salida_cruda.h"
+
+struct ConfigLote {
+    std::string entrada;              // directorio o fichero con una ruta por línea
+    std::string dir_salida;
+    ParametrosGris parametros;
+    RutaSimd ruta = RutaSimd::Escalar;
+    unsigned hilos_carga = 1;
+    unsigned hilos_conversion = 1;
+    unsigned hilos_guardado = 1;
+    size_t capacidad_cola = 8;
+    int calidad = 90;
+    bool usar_mmap = false;           // decodificar desde el fichero proyectado
+    FormatoSalida formato = FormatoSalida::Jpeg;
+    ModoEscritura escritura = ModoEscritura::Normal;  // solo para pgm y raw
+    bool huellas = false;             // escribir aHash/dHash/pHash junto a cada salida
+};
+
+struct ResultadoLote {
+    std::string fallo;    // no vacío: el lote no pudo empezar (entrada o salida inaccesible)
+    size_t imagenes = 0;
+    size_t errores = 0;
+    double segundos = 0.0;
+    // Latencias por imagen en ms
+    std::vector<double> ms_carga;
+    std::vector<double> ms_conversion;
+    std::vector<double> ms_guardado;
+};
+
+// Percentil por rango más cercano (p en [0, 100]); 0 si no hay muestras
+inline double percentil(std::vector<double> muestras, double p) {
+    if (muestras.empty()) return 0.0;
+    std::sort(muestras.begin(), muestras.end());
+    size_t rango = static_cast<size_t>(p / 100.0 * muestras.size() + 0.5);
+    rango = std::clamp<size_t>(rango, 1, muestras.size());
+    return muestras[rango - 1];
+}
+
+// Extensiones que stb_image sabe leer
+inline bool es_imagen(const std::filesystem::path& ruta) {
+    std::string ext = ruta.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (const char* e : {".jpg", ".jpeg", ".png", ".bmp", ".tga", ".psd", ".gif", ".hdr", ".pic", ".ppm", ".pgm"}) {
+        if (ext == e) return true;
+    }
+    return false;
+}
+
+// Lista de entradas: ficheros de imagen del directorio o líneas del fichero
+// de lista. Si no se puede leer, deja el motivo en `fallo`.
+inline std::vector<std::string> listar_entradas(const std::string& entrada, std::string& fallo) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> rutas;
+    std::error_code ec;
+    if (fs::is_directory(entrada, ec)) {
+        fs::directory_iterator it(entrada, ec);
+        for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            std::error_code ec_tipo;
+            if (it->is_regular_file(ec_tipo) && es_imagen(it->path())) rutas.push_back(it->path().string());
+        }
+        if (ec) {
+            fallo = "no se puede leer el directorio " + entrada + ": " + ec.message();
+            return {};
+        }
+        std::sort(rutas.begin(), rutas.end());
+    } else {
+        std::ifstream lista(entrada);
+        if (!lista) {
+            fallo = "no se puede abrir " + entrada;
+            return {};
+        }
+        std::string linea;
+        while (std::getline(lista, linea)) {
+            if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+            if (!linea.empty()) rutas.push_back(linea);
+        }
+    }
+    return rutas;
+}
+
+// Nombre de salida (sin extensión) de cada entrada: el stem, o stem_ext si
+// dos entradas comparten stem (foto.jpg y foto.png). Se compara sin
+// mayúsculas, como en los sistemas de ficheros de Windows y macOS. Si aun
+// así coinciden (mismo nombre en directorios distintos de una lista, o un
+// stem_ext que ya existía como stem), la primera conserva el nombre y las
+// demás reciben _2, _3... sin chocar con ningún otro nombre.
+inline std::vector<std::string> nombres_salida(const std::vector<std::string>& entradas) {
+    namespace fs = std::filesystem;
+    auto minusculas = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    };
+
+    std::vector<std::string> stems, claves;
+    std::unordered_map<std::string, size_t> por_stem;
+    for (const auto& e : entradas) {
+        stems.push_back(fs::path(e).stem().string());
+        claves.push_back(minusculas(stems.back()));
+        ++por_stem[claves.back()];
+    }
+
+    // Nombre preferido de cada entrada; todos quedan reservados para que un
+    // sufijo numérico no ocupe el de otra entrada
+    std::vector<std::string> nombres(entradas.size());
+    std::unordered_set<std::string> preferidos;
+    for (size_t i = 0; i < entradas.size(); ++i) {
+        nombres[i] = stems[i];
+        if (por_stem[claves[i]] > 1) {
+            const std::string ext = fs::path(entradas[i]).extension().string();
+            if (!ext.empty()) {
+                nombres[i] += "_" + ext.substr(1);
+                claves[i] += "_" + minusculas(ext.substr(1));
+            }
+        }
+        preferidos.insert(claves[i]);
+    }
+
+    std::unordered_set<std::string> vistos;
+    for (size_t i = 0; i < entradas.size(); ++i) {
+        if (vistos.insert(claves[i]).second) continue;
+        for (size_t n = 2;; ++n) {
+            const std::string sufijo = "_" + std::to_string(n);
+            const std::string clave = claves[i] + sufijo;
+            if (!preferidos.count(clave) && vistos.insert(clave).second) {
+                nombres[i] += sufijo;
+                break;
+            }
+        }
+    }
+    return nombres;
+}
+
+struct LiberarStbi {
+    void operator()(unsigned char* p) const { stbi_image_free(p); }
+};
+
+// Imagen en tránsito entre etapas
+struct TrabajoImagen {
+    std::string entrada;
+    std::string salida;   // ruta final, ya con extensión
+    std::unique_ptr<unsigned char, LiberarStbi> rgb;
+    BufferPool gray;      // del pool de buffers: se reutiliza entre imágenes
+    int width = 0;
+    int height = 0;
+    Huellas huellas;      // si cfg.huellas
+};
+
+inline ResultadoLote procesar_lote(const ConfigLote& cfg) {
+    namespace fs = std::filesystem;
+    using reloj = std::chrono::high_resolution_clock;
+
+    ResultadoLote res;
+    const std::vector<std::string> entradas = listar_entradas(cfg.entrada, res.fallo);
+    if (!res.fallo.empty()) return res;
+    std::error_code ec;
+    fs::create_directories(cfg.dir_salida, ec);
+    if (ec) {
+        res.fallo = "no se puede crear el directorio " + cfg.dir_salida + ": " + ec.message();
+        return res;
+    }
+    const std::vector<std::string> nombres = nombres_salida(entradas);
+
+    ColaAcotada<TrabajoImagen> cola_conversion(cfg.capacidad_cola);
+    ColaAcotada<TrabajoImagen> cola_guardado(cfg.capacidad_cola);
+    std::atomic<size_t> siguiente{0};
+    std::atomic<size_t> errores{0};
+    std::atomic<size_t> guardadas{0};
+    std::mutex mutex_latencias;
+
+    auto ms_desde = [](reloj::time_point inicio) {
+        return std::chrono::duration<double, std::milli>(reloj::now() - inicio).count();
+    };
+    auto anotar = [&](std::vector<double>& destino, const std::vector<double>& locales) {
+        std::lock_guard<std::mutex> lock(mutex_latencias);
+        destino.insert(destino.end(), locales.begin(), locales.end());
+    };
+
+    auto inicio = reloj::now();
+
+    std::vector<std::thread> carga, conversion, guardado;
+    for (unsigned h = 0; h < std::max(1u, cfg.hilos_carga); ++h) {
+        carga.emplace_back([&] {
+            std::vector<double> ms;
+            for (size_t i; (i = siguiente++) < entradas.size();) {
+                auto t0 = reloj::now();
+                TrabajoImagen t;
+                t.entrada = entradas[i];
+                fs::path salida = fs::path(cfg.dir_salida) / nombres[i];
+                salida += std::string(".") + nombre_formato(cfg.formato);
+                t.salida = salida.string();
+                int canales;
+                std::string motivo;
+                if (cfg.usar_mmap) {
+                    FicheroMapeado fichero;
+                    if (fichero.abrir(t.entrada)) {
+                        t.rgb.reset(stbi_load_from_memory(fichero.datos(), static_cast<int>(fichero.size()),
+                                                          &t.width, &t.height, &canales, 3));
+                    } else {
+                        motivo = fichero.error();
+                    }
+                } else {
+                    t.rgb.reset(stbi_load(t.entrada.c_str(), &t.width, &t.height, &canales, 3));
+                }
+                if (!t.rgb) {
+                    if (motivo.empty()) motivo = stbi_failure_reason();
+                    std::cerr << "Error cargando " << t.entrada << ": " << motivo << "\n";
+                    ++errores;
+                    continue;
+                }
+                ms.push_back(ms_desde(t0));
+                cola_conversion.poner(std::move(t));
+            }
+            anotar(res.ms_carga, ms);
+        });
+    }
+    for (unsigned h = 0; h < std::max(1u, cfg.hilos_conversion); ++h) {
+        conversion.emplace_back([&] {
+            std::vector<double> ms;
+            TrabajoImagen t;
+            while (cola_conversion.sacar(t)) {
+                auto t0 = reloj::now();
+                const size_t n = static_cast<size_t>(t.width) * t.height;
+                t.gray = reservar_buffer(n);
+                convertir_gris(t.rgb.get(), t.gray.get(), n, cfg.parametros, cfg.ruta);
+                if (cfg.huellas) t.huellas = calcular_huellas(t.gray.get(), t.width, t.height, cfg.ruta);
+                t.rgb.reset();  // el RGB ya no hace falta: liberar antes de encolar
+                ms.push_back(ms_desde(t0));
+                cola_guardado.poner(std::move(t));
+            }
+            anotar(res.ms_conversion, ms);
+        });
+    }
+    for (unsigned h = 0; h < std::max(1u, cfg.hilos_guardado); ++h) {
+        guardado.emplace_back([&] {
+            std::vector<double> ms;
+            TrabajoImagen t;
+            while (cola_guardado.sacar(t)) {
+                auto t0 = reloj::now();
+                const fs::path salida = t.salida;
+                ModoEscritura escritura = cfg.escritura;
+                const bool ok = cfg.formato == FormatoSalida::Jpeg
+                    ? stbi_write_jpg(salida.string().c_str(), t.width, t.height, 1, t.gray.get(), cfg.calidad) != 0
+                    : guardar_crudo(salida.string(), t.gray.get(), t.width, t.height, cfg.formato, escritura);
+                if (ok && cfg.huellas) {
+                    fs::path hash = salida;
+                    if (!escribir_huellas(hash.replace_extension(".hash").string(), t.huellas)) {
+                        std::cerr << "Error guardando las huellas: " << hash.string() << "\n";
+                        ++errores;  // la imagen cuenta como guardada, pero el lote falla
+                    }
+                }
+                if (ok) {
+                    ++guardadas;
+                } else {
+                    std::cerr << "Error guardando la imagen: " << salida.string() << "\n";
+                    ++errores;
+                }
+                ms.push_back(ms_desde(t0));
+            }
+            anotar(res.ms_guardado, ms);
+        });
+    }
+
+    // Cerrar cada cola cuando terminan todos sus productores
+    for (auto& t : carga) t.join();
+    cola_conversion.cerrar();
+    for (auto& t : conversion) t.join();
+    cola_guardado.cerrar();
+    for (auto& t : guardado) t.join();
+
+    res.segundos = std::chrono::duration<double>(reloj::now() - inicio).count();
+    res.imagenes = guardadas;
+    res.errores = errores;
+    return res;
+}
+
+#endif // LOTE_H
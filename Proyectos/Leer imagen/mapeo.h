@@ -0,0 +1,123 @@
+// mapeo.h - Fichero de entrada proyectado en memoria (mmap)
+//
+// stbi_load lee el fichero con stdio: copia del núcleo a un buffer de stdio
+// y de ahí a los buffers internos de stb, con una llamada a read por bloque.
+// Con el fichero proyectado, stbi_load_from_memory decodifica directamente
+// desde la caché de páginas. madvise(MADV_SEQUENTIAL) pide lectura anticipada
+// agresiva, que es el patrón de acceso de un decodificador.
+//
+// En sistemas sin mmap se lee el fichero entero a un buffer. stb recibe la
+// longitud como int, así que no se admiten ficheros de más de 2 GB.
+#ifndef MAPEO_H
+#define MAPEO_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPEO_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// false: abrir() lee el fichero entero igual que leer()
+#ifdef MAPEO_POSIX
+constexpr bool MMAP_DISPONIBLE = true;
+#else
+constexpr bool MMAP_DISPONIBLE = false;
+#endif
+
+class FicheroMapeado {
+public:
+    FicheroMapeado() = default;
+    FicheroMapeado(const FicheroMapeado&) = delete;
+    FicheroMapeado& operator=(const FicheroMapeado&) = delete;
+
+    ~FicheroMapeado() {
+#ifdef MAPEO_POSIX
+        if (mapa_) munmap(mapa_, size_);
+#endif
+    }
+
+    bool abrir(const std::string& ruta) {
+#ifdef MAPEO_POSIX
+        int fd = ::open(ruta.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error_ = "no se puede abrir el fichero";
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            error_ = "fichero vacio o sin tamano";
+            return false;
+        }
+        if (info.st_size > INT_MAX) {
+            ::close(fd);
+            error_ = "fichero demasiado grande para stbi_load_from_memory";
+            return false;
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // la proyección sigue siendo válida sin el descriptor
+        if (p == MAP_FAILED) {
+            error_ = "mmap ha fallado";
+            size_ = 0;
+            return false;
+        }
+        mapa_ = p;
+        madvise(mapa_, size_, MADV_SEQUENTIAL);
+        madvise(mapa_, size_, MADV_WILLNEED);
+        return true;
+#else
+        return leer(ruta);
+#endif
+    }
+
+    // Lee el fichero entero a un buffer, sin mmap (para comparar)
+    bool leer(const std::string& ruta) {
+        std::FILE* f = std::fopen(ruta.c_str(), "rb");
+        if (!f) {
+            error_ = "no se puede abrir el fichero";
+            return false;
+        }
+        std::fseek(f, 0, SEEK_END);
+        long n = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        if (n > INT_MAX) {
+            std::fclose(f);
+            error_ = "fichero demasiado grande para stbi_load_from_memory";
+            return false;
+        }
+        copia_.resize(n > 0 ? static_cast<size_t>(n) : 0);
+        size_ = std::fread(copia_.data(), 1, copia_.size(), f);
+        std::fclose(f);
+        if (size_ == 0 || size_ != copia_.size()) {
+            error_ = "no se pudo leer el fichero";
+            return false;
+        }
+        return true;
+    }
+
+    const unsigned char* datos() const {
+        return mapa_ ? static_cast<const unsigned char*>(mapa_) : copia_.data();
+    }
+    size_t size() const { return size_; }
+    const std::string& error() const { return error_; }
+
+    // true si los datos son una proyección y no una copia leída
+    bool mapeado() const { return mapa_ != nullptr; }
+
+private:
+    void* mapa_ = nullptr;
+    std::vector<unsigned char> copia_;   // sin mmap: contenido leído
+    size_t size_ = 0;
+    std::string error_;
+};
+
+#endif // MAPEO_H
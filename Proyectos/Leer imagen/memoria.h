@@ -0,0 +1,44 @@
+// memoria.h - Memoria pico del proceso (RSS máximo)
+#ifndef MEMORIA_H
+#define MEMORIA_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef PSAPI_VERSION
+#define PSAPI_VERSION 2   // GetProcessMemoryInfo en kernel32, sin -lpsapi
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX          // sin las macros min/max, que rompen std::min y std::max
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Pico de memoria residente en bytes desde que arrancó el proceso (0 si no se sabe)
+inline size_t memoria_pico_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage uso;
+    if (getrusage(RUSAGE_SELF, &uso) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(uso.ru_maxrss);          // bytes en macOS
+#else
+    return static_cast<size_t>(uso.ru_maxrss) * 1024;   // KB en Linux
+#endif
+#endif
+}
+
+inline double bytes_a_mb(size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+#endif // MEMORIA_H
@@ -0,0 +1,291 @@
+// multisalida.h - Varias salidas derivadas de una sola decodificación
+//
+// Un trabajo es una lista de salidas, una por línea:
+//   ruta [brillo=F] [gamma=G] [contraste=C] [niveles=NEGRO:BLANCO]
+//        [curva=FICHERO] [miniatura=ANCHO[xALTO]] [filtro=caja|bilineal|lanczos]
+//        [calidad=Q]
+// El formato sale de la extensión: .jpg, .pgm, .raw o .gray son imágenes y
+// .csv es el histograma de la imagen que describen sus operaciones.
+//
+// El motor convierte la imagen a gris una sola vez y, en la misma pasada y
+// por tramos que siguen en caché, aplica la tabla de cada salida (las salidas
+// con la misma tabla comparten buffer) y cuenta el histograma. Los
+// histogramas de cada salida se derivan del de la base, sin otra lectura. Las
+// miniaturas se reducen desde el buffer de su tabla. Al final los segmentos
+// JPEG de todas las salidas, y las escrituras sin comprimir, se reparten en un
+// solo paralelo_para.
+#ifndef MULTISALIDA_H
+#define MULTISALIDA_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "conversion_gris.h"
+#include "histograma.h"
+#include "jpeg_gris.h"
+#include "operaciones_punto.h"
+#include "pool_buffers.h"
+#include "pool_hilos.h"
+#include "redimension.h"
+#include "salida_cruda.h"
+
+struct SalidaTrabajo {
+    std::string ruta;
+    CadenaPuntos operaciones;
+    int ancho = 0, alto = 0;                       // miniatura; ancho 0 = tamaño completo
+    FiltroEscala filtro = FiltroEscala::Lanczos3;
+    int calidad = 90;
+    bool histograma = false;                       // .csv
+    FormatoSalida formato = FormatoSalida::Jpeg;
+};
+
+// Interpreta una línea de trabajo. Lanza std::runtime_error si no es válida.
+// Los valores se comprueban igual que las opciones de la línea de órdenes.
+inline SalidaTrabajo leer_salida(const std::string& linea) {
+    auto finito = [](const std::string& texto) {
+        const double v = std::stod(texto);
+        if (!std::isfinite(v)) throw std::runtime_error("el valor debe ser finito");
+        return v;
+    };
+    std::istringstream campos(linea);
+    SalidaTrabajo s;
+    if (!(campos >> s.ruta)) throw std::runtime_error("salida sin ruta");
+    const size_t punto = s.ruta.find_last_of('.');
+    s.histograma = punto != std::string::npos && s.ruta.substr(punto) == ".csv";
+    s.formato = formato_por_extension(s.ruta);
+
+    std::string campo;
+    while (campos >> campo) {
+        const size_t igual = campo.find('=');
+        if (igual == std::string::npos) throw std::runtime_error("opcion sin valor en " + s.ruta + ": " + campo);
+        const std::string clave = campo.substr(0, igual);
+        const std::string valor = campo.substr(igual + 1);
+        try {
+            if (clave == "brillo") {
+                const double brillo = finito(valor);
+                if (brillo < 0.0) throw std::runtime_error("el brillo no puede ser negativo");
+                s.operaciones.brillo(brillo);
+            } else if (clave == "gamma") {
+                const double gamma = finito(valor);
+                if (gamma <= 0.0) throw std::runtime_error("gamma debe ser positiva");
+                s.operaciones.gamma(gamma);
+            } else if (clave == "contraste") {
+                s.operaciones.contraste(finito(valor));
+            } else if (clave == "niveles") {
+                const size_t sep = valor.find(':');
+                if (sep == std::string::npos) throw std::runtime_error("niveles necesita NEGRO:BLANCO");
+                const double negro = finito(valor.substr(0, sep));
+                const double blanco = finito(valor.substr(sep + 1));
+                if (blanco <= negro) throw std::runtime_error("niveles necesita NEGRO < BLANCO");
+                s.operaciones.niveles(negro, blanco);
+            } else if (clave == "curva") s.operaciones.agregar(leer_curva(valor));
+            else if (clave == "miniatura") {
+                const size_t x = valor.find('x');
+                s.ancho = std::stoi(valor.substr(0, x));
+                s.alto = x == std::string::npos ? 0 : std::stoi(valor.substr(x + 1));
+                if (s.ancho < 1 || s.alto < 0) throw std::runtime_error("tamano no valido");
+            } else if (clave == "filtro") {
+                if (valor == "caja") s.filtro = FiltroEscala::Caja;
+                else if (valor == "bilineal") s.filtro = FiltroEscala::Bilineal;
+                else if (valor == "lanczos") s.filtro = FiltroEscala::Lanczos3;
+                else throw std::runtime_error("filtro desconocido");
+            } else if (clave == "calidad") {
+                s.calidad = std::stoi(valor);
+                if (s.calidad < 1 || s.calidad > 100) throw std::runtime_error("calidad fuera de 1..100");
+            } else {
+                throw std::runtime_error("opcion desconocida");
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("valor no valido en " + s.ruta + ": " + campo);
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(s.ruta + ": " + campo + ": " + e.what());
+        }
+    }
+    return s;
+}
+
+// Lee un fichero de trabajo: una salida por línea; '#' inicia un comentario
+inline std::vector<SalidaTrabajo> leer_trabajos(const std::string& fichero) {
+    std::ifstream in(fichero);
+    if (!in) throw std::runtime_error("no se puede abrir el trabajo " + fichero);
+    std::vector<SalidaTrabajo> salidas;
+    std::string linea;
+    while (std::getline(in, linea)) {
+        linea = linea.substr(0, linea.find('#'));
+        if (linea.find_first_not_of(" \t\r") == std::string::npos) continue;
+        salidas.push_back(leer_salida(linea));
+    }
+    if (salidas.empty()) throw std::runtime_error("el trabajo " + fichero + " no tiene salidas");
+    return salidas;
+}
+
+struct ResultadoSalida {
+    int ancho = 0, alto = 0;
+    size_t tabla = 0;          // índice de la tabla compartida
+    size_t bytes = 0;          // tamaño del fichero escrito
+    bool ok = false;
+};
+
+struct ResultadoMultisalida {
+    size_t tablas = 0;         // tablas distintas aplicadas en la pasada fusionada
+    double ms_pasada = 0.0;    // conversión + tablas + histograma
+    double ms_escala = 0.0;    // miniaturas
+    double ms_codificacion = 0.0;
+    std::vector<ResultadoSalida> salidas;
+};
+
+// Píxeles por tramo de la pasada fusionada: el gris base del tramo sigue en
+// L2 mientras se le aplican todas las tablas
+constexpr size_t TRAMO_MULTISALIDA = 16 * 1024;
+
+// Genera todas las salidas a partir de img (RGB, o gris si canales == 1).
+// `global` son las operaciones de punto comunes, aplicadas antes de las de
+// cada salida; `parametros` solo aporta los pesos de la conversión.
+inline ResultadoMultisalida ejecutar_multisalida(PoolHilos& pool, const unsigned char* img, int canales,
+                                                 int width, int height, const ParametrosGris& parametros,
+                                                 const CadenaPuntos& global, const std::vector<SalidaTrabajo>& salidas,
+                                                 RutaSimd ruta, ModoEscritura escritura) {
+    using reloj = std::chrono::high_resolution_clock;
+    auto ms_desde = [](reloj::time_point t) {
+        return std::chrono::duration<double, std::milli>(reloj::now() - t).count();
+    };
+    ResultadoMultisalida res;
+    res.salidas.resize(salidas.size());
+    const size_t n = static_cast<size_t>(width) * height;
+
+    // Tablas distintas; la identidad usa el gris base directamente
+    std::vector<Lut> tablas;
+    std::vector<bool> necesita_buffer;
+    bool hay_histograma = false;
+    for (size_t i = 0; i < salidas.size(); ++i) {
+        CadenaPuntos cadena = global;
+        for (const auto& paso : salidas[i].operaciones.pasos()) cadena.agregar(paso);
+        const Lut t = cadena.componer();
+        size_t k = std::find(tablas.begin(), tablas.end(), t) - tablas.begin();
+        if (k == tablas.size()) {
+            tablas.push_back(t);
+            necesita_buffer.push_back(false);
+        }
+        if (!salidas[i].histograma) necesita_buffer[k] = true;
+        hay_histograma = hay_histograma || salidas[i].histograma;
+        res.salidas[i].tabla = k;
+    }
+    res.tablas = tablas.size();
+
+    // Buffers: el gris base (salvo que img ya sea gris) y uno por tabla usada
+    ParametrosGris pesos = parametros;
+    pesos.usar_lut = false;
+    BufferPool base_propia = canales == 1 ? nullptr : reservar_buffer(n);
+    const unsigned char* base = canales == 1 ? img : base_propia.get();
+    std::vector<BufferPool> buffers(tablas.size());
+    std::vector<const unsigned char*> imagen(tablas.size(), base);
+    std::vector<size_t> aplicar;   // tablas con buffer propio
+    for (size_t k = 0; k < tablas.size(); ++k) {
+        if (!necesita_buffer[k] || es_identidad(tablas[k])) continue;
+        buffers[k] = reservar_buffer(n);
+        imagen[k] = buffers[k].get();
+        aplicar.push_back(k);
+    }
+
+    // Pasada fusionada por bandas: convertir, aplicar las tablas y contar
+    auto t0 = reloj::now();
+    const size_t n_bandas = std::max<size_t>(1, std::min<size_t>(pool.size(), n));
+    std::vector<Histograma> parciales(hay_histograma ? n_bandas : 0, Histograma{});
+    pool.paralelo_para(n_bandas, [&](size_t b) {
+        Histograma local{};
+        const size_t fin = n * (b + 1) / n_bandas;
+        for (size_t i = n * b / n_bandas; i < fin; i += TRAMO_MULTISALIDA) {
+            const size_t m = std::min(TRAMO_MULTISALIDA, fin - i);
+            if (canales != 1) convertir_gris(img + i * 3, base_propia.get() + i, m, pesos, ruta);
+            if (hay_histograma) acumular_histograma(base + i, m, local);
+            for (size_t k : aplicar) aplicar_lut(base + i, buffers[k].get() + i, m, tablas[k], ruta);
+        }
+        if (hay_histograma) parciales[b] = local;
+    });
+    Histograma histograma{};
+    for (const Histograma& p : parciales)
+        for (int v = 0; v < 256; ++v) histograma[v] += p[v];
+    res.ms_pasada = ms_desde(t0);
+
+    // Miniaturas, cada una repartida entre los hilos
+    t0 = reloj::now();
+    std::vector<BufferPool> miniaturas(salidas.size());
+    for (size_t i = 0; i < salidas.size(); ++i) {
+        ResultadoSalida& r = res.salidas[i];
+        r.ancho = width;
+        r.alto = height;
+        if (salidas[i].histograma || salidas[i].ancho == 0) continue;
+        r.ancho = salidas[i].ancho;
+        r.alto = salidas[i].alto ? salidas[i].alto
+                                 : std::max(1, static_cast<int>(std::lround(static_cast<double>(height) * r.ancho / width)));
+        miniaturas[i] = reservar_buffer(static_cast<size_t>(r.ancho) * r.alto);
+        redimensionar(pool, imagen[r.tabla], width, height, miniaturas[i].get(), r.ancho, r.alto,
+                      salidas[i].filtro, ruta);
+    }
+    res.ms_escala = ms_desde(t0);
+
+    // Codificación: los segmentos de todos los JPEG y las demás escrituras
+    // son tareas de un mismo paralelo_para
+    t0 = reloj::now();
+    std::vector<CodificacionJpegSegmentada> jpeg(salidas.size());
+    struct Tarea {
+        size_t salida;
+        size_t segmento;   // solo JPEG
+    };
+    std::vector<Tarea> tareas;
+    size_t n_jpeg = 0;
+    for (const SalidaTrabajo& s : salidas) n_jpeg += !s.histograma && s.formato == FormatoSalida::Jpeg;
+    const int objetivo = std::max(1, static_cast<int>(pool.size() * 4 / std::max<size_t>(1, n_jpeg)));
+    for (size_t i = 0; i < salidas.size(); ++i) {
+        ResultadoSalida& r = res.salidas[i];
+        const unsigned char* datos = miniaturas[i] ? miniaturas[i].get() : imagen[r.tabla];
+        if (!salidas[i].histograma && salidas[i].formato == FormatoSalida::Jpeg) {
+            r.ok = jpeg[i].preparar(datos, r.ancho, r.alto, salidas[i].calidad, objetivo);
+            for (size_t s = 0; r.ok && s < jpeg[i].segmentos(); ++s) tareas.push_back({i, s});
+        } else {
+            tareas.push_back({i, 0});
+        }
+    }
+    pool.paralelo_para(tareas.size(), [&](size_t j) {
+        const size_t i = tareas[j].salida;
+        const SalidaTrabajo& s = salidas[i];
+        ResultadoSalida& r = res.salidas[i];
+        if (s.histograma) {
+            r.ok = escribir_histograma(s.ruta, transformar_histograma(histograma, tablas[r.tabla]));
+        } else if (s.formato == FormatoSalida::Jpeg) {
+            jpeg[i].codificar_segmento(tareas[j].segmento);
+        } else {
+            ModoEscritura modo = escritura;
+            const unsigned char* datos = miniaturas[i] ? miniaturas[i].get() : imagen[r.tabla];
+            r.ok = guardar_crudo(s.ruta, datos, r.ancho, r.alto, s.formato, modo);
+            r.bytes = (s.formato == FormatoSalida::Pgm ? cabecera_pgm(r.ancho, r.alto).size() : 0) +
+                      static_cast<size_t>(r.ancho) * r.alto;
+        }
+    });
+
+    // Ensamblar y escribir los JPEG, también en paralelo
+    std::vector<size_t> pendientes;
+    for (size_t i = 0; i < salidas.size(); ++i) {
+        if (!salidas[i].histograma && salidas[i].formato == FormatoSalida::Jpeg && res.salidas[i].ok) {
+            pendientes.push_back(i);
+        }
+    }
+    pool.paralelo_para(pendientes.size(), [&](size_t j) {
+        const size_t i = pendientes[j];
+        std::vector<unsigned char> bytes;
+        jpeg[i].ensamblar(bytes);
+        res.salidas[i].ok = escribir_fichero(salidas[i].ruta, bytes);
+        res.salidas[i].bytes = bytes.size();
+    });
+    res.ms_codificacion = ms_desde(t0);
+    return res;
+}
+
+#endif // MULTISALIDA_H
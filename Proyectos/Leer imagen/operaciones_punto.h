@@ -0,0 +1,207 @@
+// operaciones_punto.h - Operaciones de punto precalculadas en una tabla de 256
+//
+// Un píxel gris solo puede valer 0..255, así que cualquier cadena de
+// operaciones por píxel (brillo, gamma, contraste, niveles, curvas) se reduce
+// a una tabla de 256 entradas. La tabla se calcula una vez y se aplica en una
+// sola pasada: encadenar varios ajustes cuesta lo mismo que uno.
+//
+// Cada operación se evalúa en 8 bits, en el orden de la cadena, de modo que
+// el resultado es el mismo que aplicar las operaciones una tras otra.
+#ifndef OPERACIONES_PUNTO_H
+#define OPERACIONES_PUNTO_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rutas_simd.h"
+
+using Lut = std::array<unsigned char, 256>;
+
+// Tabla identidad: Lut[i] = i
+inline Lut lut_identidad() {
+    Lut t;
+    for (int i = 0; i < 256; ++i) t[i] = static_cast<unsigned char>(i);
+    return t;
+}
+
+inline bool es_identidad(const Lut& t) {
+    for (int i = 0; i < 256; ++i)
+        if (t[i] != i) return false;
+    return true;
+}
+
+// Función para ajustar el brillo (0.0 = negro, 1.0 = normal, >1.0 más brillante)
+inline unsigned char adjust_brightness(unsigned char pixel, float brightness) {
+    float adjusted = pixel * brightness;
+    return static_cast<unsigned char>(std::clamp(adjusted, 0.0f, 255.0f));
+}
+
+inline unsigned char redondear_pixel(double v) {
+    return static_cast<unsigned char>(std::lround(std::clamp(v, 0.0, 255.0)));
+}
+
+struct OperacionPunto {
+    enum class Tipo { Brillo, Gamma, Contraste, Niveles, Curva };
+    Tipo tipo = Tipo::Brillo;
+    double a = 1.0;   // brillo, gamma, contraste o nivel de negro
+    double b = 255.0; // nivel de blanco
+    std::vector<std::pair<int, int>> puntos;  // curva: (entrada, salida) ordenados
+
+    // Tabla de esta operación sola
+    Lut tabla() const {
+        Lut t;
+        for (int x = 0; x < 256; ++x) {
+            switch (tipo) {
+                case Tipo::Brillo:
+                    t[x] = adjust_brightness(static_cast<unsigned char>(x), static_cast<float>(a));
+                    break;
+                case Tipo::Gamma:
+                    // gamma > 1 aclara los medios tonos, < 1 los oscurece
+                    t[x] = redondear_pixel(255.0 * std::pow(x / 255.0, 1.0 / a));
+                    break;
+                case Tipo::Contraste:
+                    t[x] = redondear_pixel((x - 127.5) * a + 127.5);
+                    break;
+                case Tipo::Niveles:
+                    t[x] = redondear_pixel((x - a) * 255.0 / (b - a));
+                    break;
+                case Tipo::Curva:
+                    t[x] = evaluar_curva(x);
+                    break;
+            }
+        }
+        return t;
+    }
+
+private:
+    // Interpolación lineal entre puntos de control; plana fuera de los extremos
+    unsigned char evaluar_curva(int x) const {
+        if (puntos.empty()) return static_cast<unsigned char>(x);
+        if (x <= puntos.front().first) return static_cast<unsigned char>(puntos.front().second);
+        if (x >= puntos.back().first) return static_cast<unsigned char>(puntos.back().second);
+        auto sig = std::upper_bound(puntos.begin(), puntos.end(), std::make_pair(x, 256));
+        auto ant = sig - 1;
+        double t = static_cast<double>(x - ant->first) / (sig->first - ant->first);
+        return redondear_pixel(ant->second + t * (sig->second - ant->second));
+    }
+};
+
+// Lee una curva de un fichero de texto: una pareja "entrada salida" (0..255)
+// por línea; '#' inicia un comentario. Lanza std::runtime_error si no es válida.
+inline OperacionPunto leer_curva(const std::string& fichero) {
+    std::ifstream in(fichero);
+    if (!in) throw std::runtime_error("no se puede abrir la curva " + fichero);
+
+    OperacionPunto op;
+    op.tipo = OperacionPunto::Tipo::Curva;
+    std::string linea;
+    while (std::getline(in, linea)) {
+        linea = linea.substr(0, linea.find('#'));
+        std::istringstream campos(linea);
+        int entrada, salida;
+        if (!(campos >> entrada)) continue;
+        if (!(campos >> salida) || entrada < 0 || entrada > 255 || salida < 0 || salida > 255) {
+            throw std::runtime_error("linea de curva no valida en " + fichero + ": " + linea);
+        }
+        op.puntos.emplace_back(entrada, salida);
+    }
+    if (op.puntos.empty()) throw std::runtime_error("la curva " + fichero + " no tiene puntos");
+    std::sort(op.puntos.begin(), op.puntos.end());
+    return op;
+}
+
+// Cadena de operaciones que se compone en una sola tabla
+class CadenaPuntos {
+public:
+    void brillo(double factor) { agregar(OperacionPunto::Tipo::Brillo, factor); }
+    void gamma(double g) { agregar(OperacionPunto::Tipo::Gamma, g); }
+    void contraste(double c) { agregar(OperacionPunto::Tipo::Contraste, c); }
+    void niveles(double negro, double blanco) { agregar(OperacionPunto::Tipo::Niveles, negro, blanco); }
+    void agregar(OperacionPunto op) { ops_.push_back(std::move(op)); }
+
+    bool vacia() const { return ops_.empty(); }
+    size_t size() const { return ops_.size(); }
+    const std::vector<OperacionPunto>& pasos() const { return ops_; }
+
+    // Compone las tablas: resultado[x] = op_n(...op_1(x))
+    Lut componer() const {
+        Lut t = lut_identidad();
+        for (const auto& op : ops_) {
+            Lut paso = op.tabla();
+            for (auto& v : t) v = paso[v];
+        }
+        return t;
+    }
+
+private:
+    void agregar(OperacionPunto::Tipo tipo, double a, double b = 255.0) {
+        OperacionPunto op;
+        op.tipo = tipo;
+        op.a = a;
+        op.b = b;
+        ops_.push_back(op);
+    }
+
+    std::vector<OperacionPunto> ops_;
+};
+
+// Aplica la tabla: salida[i] = t[entrada[i]] (entrada y salida pueden coincidir)
+inline void aplicar_lut_escalar(const unsigned char* entrada, unsigned char* salida,
+                                size_t n, const Lut& t) {
+    for (size_t i = 0; i < n; ++i) salida[i] = t[entrada[i]];
+}
+
+#ifdef RUTAS_SIMD_X86
+
+// Ruta AVX2: la tabla se parte en 16 trozos de 16 bytes y cada trozo se
+// consulta con pshufb. Para el trozo k el índice es x - 16k; sumarle 0x70 con
+// saturación deja los índices 0..15 con el bit alto a cero y lleva el resto
+// a >= 0x80, que pshufb convierte en 0. Se combinan los 16 resultados con OR.
+__attribute__((target("avx2")))
+inline void aplicar_lut_avx2(const unsigned char* entrada, unsigned char* salida,
+                             size_t n, const Lut& t) {
+    __m256i trozos[16];
+    for (int k = 0; k < 16; ++k) {
+        trozos[k] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.data() + 16 * k)));
+    }
+    const __m256i dieciseis = _mm256_set1_epi8(16);
+    const __m256i sesgo = _mm256_set1_epi8(0x70);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(entrada + i));
+        __m256i res = _mm256_setzero_si256();
+        for (int k = 0; k < 16; ++k) {
+            res = _mm256_or_si256(res, _mm256_shuffle_epi8(trozos[k], _mm256_adds_epu8(x, sesgo)));
+            x = _mm256_sub_epi8(x, dieciseis);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(salida + i), res);
+    }
+
+    aplicar_lut_escalar(entrada + i, salida + i, n - i, t);
+}
+
+#endif // RUTAS_SIMD_X86
+
+// SSE2 no tiene pshufb: usa la ruta escalar
+inline void aplicar_lut(const unsigned char* entrada, unsigned char* salida, size_t n,
+                        const Lut& t, RutaSimd ruta) {
+#ifdef RUTAS_SIMD_X86
+    if (ruta == RutaSimd::AVX2) {
+        aplicar_lut_avx2(entrada, salida, n, t);
+        return;
+    }
+#endif
+    aplicar_lut_escalar(entrada, salida, n, t);
+}
+
+#endif // OPERACIONES_PUNTO_H
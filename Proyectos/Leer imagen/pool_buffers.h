@@ -0,0 +1,227 @@
+// pool_buffers.h - Pool de buffers grandes por clases de tamaño
+//
+// Cada imagen reserva y libera los mismos buffers grandes: la salida de
+// stbi_load, los planos internos del decodificador JPEG y el buffer gris.
+// En un lote largo eso fragmenta el montón y cuesta fallos de página en cada
+// imagen. Este pool guarda los buffers liberados por clase de tamaño y los
+// devuelve a la siguiente reserva de la misma clase, ya con las páginas
+// residentes.
+//
+// Las clases son potencias de dos con 4 subdivisiones (como mucho un 25 % de
+// desperdicio). Por debajo de MINIMO_POOL se usa malloc directamente. En Linux
+// los bloques de 2 MB o más se piden con mmap alineado a 2 MB y
+// MADV_HUGEPAGE, para que el núcleo los respalde con páginas enormes.
+//
+// Para que stb_image lo use, incluir este fichero y definir antes de
+// stb_image.h:
+//   #define STBI_MALLOC(sz)    pool_malloc(sz)
+//   #define STBI_REALLOC(p,sz) pool_realloc(p, sz)
+//   #define STBI_FREE(p)       pool_free(p)
+#ifndef POOL_BUFFERS_H
+#define POOL_BUFFERS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+class PoolBuffers {
+public:
+    static constexpr size_t MINIMO_POOL = 64 * 1024;           // por debajo, malloc directo
+    static constexpr size_t PAGINA_ENORME = 2 * 1024 * 1024;
+    static constexpr size_t CABECERA = 64;                     // mantiene la alineación a 64
+
+    struct Estadisticas {
+        size_t reservas = 0;              // peticiones de MINIMO_POOL o más
+        size_t reservas_sistema = 0;      // de ellas, las que pidieron memoria nueva
+        size_t reutilizadas = 0;          // servidas desde el pool
+        size_t bytes_reutilizados = 0;
+        size_t bytes_en_cache = 0;        // libres en el pool ahora mismo
+        size_t reservas_pequenas = 0;     // por debajo de MINIMO_POOL (malloc)
+    };
+
+    explicit PoolBuffers(size_t max_cache = size_t(1) << 30) : max_cache_(max_cache) {}
+    PoolBuffers(const PoolBuffers&) = delete;
+    PoolBuffers& operator=(const PoolBuffers&) = delete;
+    ~PoolBuffers() { vaciar(); }
+
+    void* reservar(size_t n) {
+        if (n < MINIMO_POOL) {
+            auto* c = static_cast<Cabecera*>(std::malloc(n + CABECERA));
+            if (!c) return nullptr;
+            *c = Cabecera{n, n, -1, false};
+            std::lock_guard<std::mutex> lock(m_);
+            ++est_.reservas_pequenas;
+            return datos(c);
+        }
+
+        size_t capacidad;
+        const int clase = clase_de(n, capacidad);
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            ++est_.reservas;
+            if (clase < static_cast<int>(libres_.size()) && !libres_[clase].empty()) {
+                Cabecera* c = libres_[clase].back();
+                libres_[clase].pop_back();
+                c->pedido = n;
+                ++est_.reutilizadas;
+                est_.bytes_reutilizados += c->capacidad;
+                est_.bytes_en_cache -= c->capacidad;
+                return datos(c);
+            }
+            ++est_.reservas_sistema;
+        }
+        Cabecera* c = reservar_sistema(capacidad);
+        if (!c) return nullptr;
+        c->pedido = n;
+        c->clase = clase;
+        return datos(c);
+    }
+
+    void liberar(void* p) {
+        if (!p) return;
+        Cabecera* c = cabecera(p);
+        if (c->clase < 0) {
+            std::free(c);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if (est_.bytes_en_cache + c->capacidad <= max_cache_) {
+                if (c->clase >= static_cast<int>(libres_.size())) libres_.resize(c->clase + 1);
+                libres_[c->clase].push_back(c);
+                est_.bytes_en_cache += c->capacidad;
+                return;
+            }
+        }
+        liberar_sistema(c);
+    }
+
+    void* redimensionar(void* p, size_t n) {
+        if (!p) return reservar(n);
+        Cabecera* c = cabecera(p);
+        if (n <= c->capacidad && (c->clase >= 0 || n < MINIMO_POOL)) {
+            c->pedido = n;
+            return p;
+        }
+        void* nuevo = reservar(n);
+        if (!nuevo) return nullptr;
+        std::memcpy(nuevo, p, std::min(c->pedido, n));
+        liberar(p);
+        return nuevo;
+    }
+
+    // Devuelve al sistema todos los buffers libres
+    void vaciar() {
+        std::lock_guard<std::mutex> lock(m_);
+        for (auto& lista : libres_) {
+            for (Cabecera* c : lista) liberar_sistema(c);
+            lista.clear();
+        }
+        est_.bytes_en_cache = 0;
+    }
+
+    Estadisticas estadisticas() const {
+        std::lock_guard<std::mutex> lock(m_);
+        return est_;
+    }
+
+private:
+    struct Cabecera {
+        size_t capacidad;   // bytes útiles del bloque
+        size_t pedido;      // bytes de la última petición (para realloc)
+        int clase;          // -1 = malloc directo
+        bool mapeado;       // true = mmap (páginas enormes)
+    };
+    static_assert(sizeof(Cabecera) <= CABECERA, "la cabecera no cabe");
+
+    static void* datos(Cabecera* c) { return reinterpret_cast<unsigned char*>(c) + CABECERA; }
+    static Cabecera* cabecera(void* p) {
+        return reinterpret_cast<Cabecera*>(static_cast<unsigned char*>(p) - CABECERA);
+    }
+
+    // Clase de n y su capacidad: 2^k, 1.25 * 2^k, 1.5 * 2^k o 1.75 * 2^k
+    static int clase_de(size_t n, size_t& capacidad) {
+        int k = 0;
+        while ((size_t(2) << k) <= n) ++k;          // 2^k <= n < 2^(k+1)
+        const size_t base = size_t(1) << k;
+        const size_t paso = base / 4;
+        size_t j = (n - base + paso - 1) / paso;
+        if (j == 4) {
+            ++k;
+            j = 0;
+        }
+        capacidad = (size_t(1) << k) + j * ((size_t(1) << k) / 4);
+        return (k - 16) * 4 + static_cast<int>(j);  // MINIMO_POOL = 2^16
+    }
+
+    static Cabecera* reservar_sistema(size_t capacidad) {
+        const size_t total = capacidad + CABECERA;
+#ifdef __linux__
+        if (total >= PAGINA_ENORME) {
+            // Se pide 2 MB de más y se recorta para alinear el bloque a 2 MB
+            const size_t redondeado = (total + PAGINA_ENORME - 1) / PAGINA_ENORME * PAGINA_ENORME;
+            void* p = mmap(nullptr, redondeado + PAGINA_ENORME, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                auto inicio = reinterpret_cast<uintptr_t>(p);
+                auto alineado = (inicio + PAGINA_ENORME - 1) / PAGINA_ENORME * PAGINA_ENORME;
+                if (alineado > inicio) munmap(p, alineado - inicio);
+                munmap(reinterpret_cast<void*>(alineado + redondeado), inicio + PAGINA_ENORME - alineado);
+                madvise(reinterpret_cast<void*>(alineado), redondeado, MADV_HUGEPAGE);
+                auto* c = reinterpret_cast<Cabecera*>(alineado);
+                *c = Cabecera{redondeado - CABECERA, 0, 0, true};
+                return c;
+            }
+        }
+#endif
+        auto* c = static_cast<Cabecera*>(std::malloc(total));
+        if (c) *c = Cabecera{capacidad, 0, 0, false};
+        return c;
+    }
+
+    static void liberar_sistema(Cabecera* c) {
+#ifdef __linux__
+        if (c->mapeado) {
+            munmap(c, c->capacidad + CABECERA);
+            return;
+        }
+#endif
+        std::free(c);
+    }
+
+    mutable std::mutex m_;
+    std::vector<std::vector<Cabecera*>> libres_;   // bloques libres por clase
+    Estadisticas est_;
+    size_t max_cache_;
+};
+
+// Pool compartido por todo el programa
+inline PoolBuffers& pool_buffers() {
+    static PoolBuffers pool;
+    return pool;
+}
+
+inline void* pool_malloc(size_t n) { return pool_buffers().reservar(n); }
+inline void* pool_realloc(void* p, size_t n) { return pool_buffers().redimensionar(p, n); }
+inline void pool_free(void* p) { pool_buffers().liberar(p); }
+
+// Buffer de bytes del pool con liberación automática
+struct LiberarBufferPool {
+    void operator()(unsigned char* p) const { pool_free(p); }
+};
+using BufferPool = std::unique_ptr<unsigned char[], LiberarBufferPool>;
+
+inline BufferPool reservar_buffer(size_t n) {
+    return BufferPool(static_cast<unsigned char*>(pool_malloc(n)));
+}
+
+#endif // POOL_BUFFERS_H
@@ -0,0 +1,92 @@
+// pool_hilos.h - Pool de hilos persistente para repartir trabajo
+//
+// Los hilos se crean una vez y esperan tareas en una cola protegida por mutex.
+// paralelo_para(n, f) reparte f(0..n-1) entre los hilos y espera a que terminen.
+#ifndef POOL_HILOS_H
+#define POOL_HILOS_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Hilos por defecto: los que reporta el sistema (al menos 1)
+inline unsigned hilos_por_defecto() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+class PoolHilos {
+public:
+    explicit PoolHilos(unsigned n_hilos = hilos_por_defecto()) {
+        if (n_hilos == 0) n_hilos = 1;
+        for (unsigned i = 0; i < n_hilos; ++i) {
+            workers_.emplace_back([this] { bucle(); });
+        }
+    }
+
+    ~PoolHilos() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            parar_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    PoolHilos(const PoolHilos&) = delete;
+    PoolHilos& operator=(const PoolHilos&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+    // Añade una tarea a la cola; la ejecutará el primer hilo libre
+    void encolar(std::function<void()> tarea) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tareas_.push(std::move(tarea));
+        }
+        cv_.notify_one();
+    }
+
+    // Ejecuta f(i) para i en [0, n) y espera a que terminen todas
+    template <class F>
+    void paralelo_para(size_t n, F f) {
+        std::mutex m;
+        std::condition_variable fin;
+        size_t pendientes = n;
+        for (size_t i = 0; i < n; ++i) {
+            encolar([&, i] {
+                f(i);
+                std::lock_guard<std::mutex> lock(m);
+                if (--pendientes == 0) fin.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(m);
+        fin.wait(lock, [&] { return pendientes == 0; });
+    }
+
+private:
+    void bucle() {
+        for (;;) {
+            std::function<void()> tarea;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return parar_ || !tareas_.empty(); });
+                if (parar_ && tareas_.empty()) return;
+                tarea = std::move(tareas_.front());
+                tareas_.pop();
+            }
+            tarea();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tareas_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool parar_ = false;
+};
+
+#endif // POOL_HILOS_H
@@ -0,0 +1,240 @@
+// redimension.h - Cambio de tamaño de la imagen gris (miniaturas)
+//
+// Filtros de caja, bilineal y Lanczos-3. Cada eje tiene su tabla de pesos
+// precalculada: para cada píxel de salida, el primer píxel de entrada y los
+// pesos en Q14 (suman exactamente 1 << 14). Al reducir, el soporte del filtro
+// se ensancha en la misma proporción para promediar todos los píxeles de
+// entrada. Los pesos que caen fuera de la imagen se suman al píxel del borde.
+//
+// Por cada fila de salida se hace primero la pasada vertical, que combina
+// filas completas de entrada (contigua, 16 píxeles por iteración con AVX2), y
+// después la horizontal sobre esa única fila intermedia, con el producto
+// escalar de los pesos vectorizado por pmaddwd. Las filas de salida se
+// reparten en bandas entre los hilos del pool.
+#ifndef REDIMENSION_H
+#define REDIMENSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "pool_hilos.h"
+#include "rutas_simd.h"
+
+enum class FiltroEscala { Caja, Bilineal, Lanczos3 };
+
+inline const char* nombre_filtro_escala(FiltroEscala f) {
+    switch (f) {
+        case FiltroEscala::Caja:     return "caja";
+        case FiltroEscala::Bilineal: return "bilineal";
+        default:                     return "lanczos";
+    }
+}
+
+// Pesos de un eje: la salida i usa entrada[inicio[i] .. inicio[i] + taps)
+// con pesos[i * taps ...]. taps es par y los pesos sobrantes son 0.
+struct TablaPesos {
+    int taps = 0;
+    std::vector<int> inicio;
+    std::vector<short> pesos;
+};
+
+inline double nucleo_escala(FiltroEscala f, double x) {
+    x = std::abs(x);
+    switch (f) {
+        case FiltroEscala::Caja:
+            return x < 0.5 ? 1.0 : 0.0;
+        case FiltroEscala::Bilineal:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        default: {
+            if (x < 1e-8) return 1.0;
+            if (x >= 3.0) return 0.0;
+            const double pi_x = 3.14159265358979323846 * x;
+            return 3.0 * std::sin(pi_x) * std::sin(pi_x / 3.0) / (pi_x * pi_x);
+        }
+    }
+}
+
+inline double soporte_escala(FiltroEscala f) {
+    switch (f) {
+        case FiltroEscala::Caja:     return 0.5;
+        case FiltroEscala::Bilineal: return 1.0;
+        default:                     return 3.0;
+    }
+}
+
+inline TablaPesos tabla_pesos(int entrada, int salida, FiltroEscala f) {
+    const double razon = static_cast<double>(entrada) / salida;
+    const double escala = std::max(1.0, razon);        // al reducir se ensancha el filtro
+    const double soporte = soporte_escala(f) * escala;
+
+    // Pesos reales por salida, ya plegados a [0, entrada)
+    std::vector<std::vector<double>> reales(salida);
+    std::vector<int> inicio(salida);
+    int taps = 0;
+    for (int i = 0; i < salida; ++i) {
+        const double centro = (i + 0.5) * razon - 0.5;
+        const int j0 = static_cast<int>(std::floor(centro - soporte));
+        const int j1 = static_cast<int>(std::ceil(centro + soporte));
+        const int primero = std::clamp(j0, 0, entrada - 1);
+        const int ultimo = std::clamp(j1, 0, entrada - 1);
+        std::vector<double>& w = reales[i];
+        w.assign(ultimo - primero + 1, 0.0);
+        double suma = 0.0;
+        for (int j = j0; j <= j1; ++j) {
+            double v = nucleo_escala(f, (j - centro) / escala);
+            w[std::clamp(j, 0, entrada - 1) - primero] += v;
+            suma += v;
+        }
+        if (suma == 0.0) {
+            // Caja al ampliar justo en el borde de dos píxeles: el más cercano
+            w[std::clamp(static_cast<int>(std::lround(centro)), primero, ultimo) - primero] = suma = 1.0;
+        }
+        for (double& v : w) v /= suma;
+        inicio[i] = primero;
+        taps = std::max(taps, static_cast<int>(w.size()));
+    }
+
+    TablaPesos t;
+    t.taps = taps + (taps % 2);
+    t.inicio = inicio;
+    t.pesos.assign(static_cast<size_t>(salida) * t.taps, 0);
+    for (int i = 0; i < salida; ++i) {
+        // Redondeo acumulado: cada peso es la diferencia entre sumas parciales
+        // redondeadas, así el error nunca pasa de medio paso por peso y el
+        // total es 1 << 14 aunque los pesos reales valgan menos de un paso
+        // (reducciones de más de 16000 a 1)
+        short* q = t.pesos.data() + static_cast<size_t>(i) * t.taps;
+        const std::vector<double>& w = reales[i];
+        double acumulado = 0.0;
+        long anterior = 0;
+        for (size_t k = 0; k < w.size(); ++k) {
+            acumulado += w[k];
+            const long actual = k + 1 == w.size() ? 1 << 14 : std::lround(acumulado * (1 << 14));
+            q[k] = static_cast<short>(actual - anterior);
+            anterior = actual;
+        }
+    }
+    return t;
+}
+
+// Pasada vertical: combina `taps` filas de bytes en una fila Q6 de 16 bits.
+// Q6 deja margen a los lóbulos negativos de Lanczos (hasta ±511).
+inline void escala_vertical_escalar(const unsigned char* const* filas, const short* pesos, int taps,
+                                    short* salida, int n) {
+    for (int x = 0; x < n; ++x) {
+        int acc = 1 << 7;
+        for (int t = 0; t < taps; ++t) acc += pesos[t] * filas[t][x];
+        salida[x] = static_cast<short>(std::clamp(acc >> 8, -32768, 32767));
+    }
+}
+
+// Pasada horizontal: de la fila Q6 a bytes
+inline void escala_horizontal_escalar(const short* linea, const TablaPesos& t, unsigned char* salida, int n) {
+    for (int i = 0; i < n; ++i) {
+        const short* e = linea + t.inicio[i];
+        const short* w = t.pesos.data() + static_cast<size_t>(i) * t.taps;
+        int acc = 1 << 19;
+        for (int k = 0; k < t.taps; ++k) acc += w[k] * e[k];
+        salida[i] = static_cast<unsigned char>(std::clamp(acc >> 20, 0, 255));
+    }
+}
+
+#ifdef RUTAS_SIMD_X86
+
+__attribute__((target("avx2")))
+inline void escala_vertical_avx2(const unsigned char* const* filas, const short* pesos, int taps,
+                                 short* salida, int n) {
+    const __m256i redondeo = _mm256_set1_epi32(1 << 7);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i lo = redondeo, hi = redondeo;
+        for (int t = 0; t < taps; t += 2) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(filas[t] + x)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(filas[t + 1] + x)));
+            __m256i w = _mm256_set1_epi32(static_cast<unsigned short>(pesos[t]) |
+                                          (static_cast<int>(pesos[t + 1]) << 16));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(salida + x),
+                            _mm256_packs_epi32(_mm256_srai_epi32(lo, 8), _mm256_srai_epi32(hi, 8)));
+    }
+    for (; x < n; ++x) {
+        int acc = 1 << 7;
+        for (int t = 0; t < taps; ++t) acc += pesos[t] * filas[t][x];
+        salida[x] = static_cast<short>(std::clamp(acc >> 8, -32768, 32767));
+    }
+}
+
+// Producto escalar de 16 pesos por iteración; `linea` debe tener al menos
+// taps + 15 posiciones de holgura tras el último inicio
+__attribute__((target("avx2")))
+inline void escala_horizontal_avx2(const short* linea, const TablaPesos& t, unsigned char* salida, int n) {
+    if (t.taps < 8) {
+        escala_horizontal_escalar(linea, t, salida, n);
+        return;
+    }
+    const int bloques = t.taps / 16;
+    for (int i = 0; i < n; ++i) {
+        const short* e = linea + t.inicio[i];
+        const short* w = t.pesos.data() + static_cast<size_t>(i) * t.taps;
+        __m256i acc = _mm256_setzero_si256();
+        int k = 0;
+        for (int b = 0; b < bloques; ++b, k += 16) {
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(e + k)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + k))));
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        if (k + 8 <= t.taps) {
+            s = _mm_add_epi32(s, _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(e + k)),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + k))));
+            k += 8;
+        }
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+        int total = _mm_cvtsi128_si32(s) + (1 << 19);
+        for (; k < t.taps; ++k) total += w[k] * e[k];
+        salida[i] = static_cast<unsigned char>(std::clamp(total >> 20, 0, 255));
+    }
+}
+
+#endif // RUTAS_SIMD_X86
+
+// Redimensiona src (width x height) a dst (ancho x alto)
+inline void redimensionar(PoolHilos& pool, const unsigned char* src, int width, int height,
+                          unsigned char* dst, int ancho, int alto, FiltroEscala filtro, RutaSimd ruta) {
+    const TablaPesos th = tabla_pesos(width, ancho, filtro);
+    const TablaPesos tv = tabla_pesos(height, alto, filtro);
+
+    const int n_bandas = std::max(1, std::min(static_cast<int>(pool.size()) * 4, alto));
+    pool.paralelo_para(n_bandas, [&](size_t b) {
+        thread_local std::vector<short> linea;
+        thread_local std::vector<const unsigned char*> filas;
+        // Holgura para que los pesos de relleno (0) lean memoria válida
+        linea.assign(static_cast<size_t>(width) + th.taps + 16, 0);
+        filas.resize(tv.taps);
+        const int y0 = static_cast<int>(static_cast<long long>(alto) * b / n_bandas);
+        const int y1 = static_cast<int>(static_cast<long long>(alto) * (b + 1) / n_bandas);
+        for (int y = y0; y < y1; ++y) {
+            for (int t = 0; t < tv.taps; ++t) {
+                filas[t] = src + static_cast<size_t>(std::min(tv.inicio[y] + t, height - 1)) * width;
+            }
+            const short* pesos = tv.pesos.data() + static_cast<size_t>(y) * tv.taps;
+            unsigned char* salida = dst + static_cast<size_t>(y) * ancho;
+#ifdef RUTAS_SIMD_X86
+            if (ruta == RutaSimd::AVX2) {
+                escala_vertical_avx2(filas.data(), pesos, tv.taps, linea.data(), width);
+                escala_horizontal_avx2(linea.data(), th, salida, ancho);
+                continue;
+            }
+#endif
+            escala_vertical_escalar(filas.data(), pesos, tv.taps, linea.data(), width);
+            escala_horizontal_escalar(linea.data(), th, salida, ancho);
+        }
+    });
+}
+
+#endif // REDIMENSION_H
@@ -0,0 +1,43 @@
+// rutas_simd.h - Selección en tiempo de ejecución de la ruta SIMD
+//
+// Cada núcleo tiene una versión escalar y, en x86, versiones SSE2 y AVX2
+// compiladas con __attribute__((target)). Aquí se decide cuál puede usar la CPU.
+#ifndef RUTAS_SIMD_H
+#define RUTAS_SIMD_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RUTAS_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+enum class RutaSimd { Escalar, SSE2, AVX2 };
+
+inline const char* nombre_ruta(RutaSimd ruta) {
+    switch (ruta) {
+        case RutaSimd::SSE2: return "sse2";
+        case RutaSimd::AVX2: return "avx2";
+        default:             return "escalar";
+    }
+}
+
+// ¿Puede esta CPU ejecutar la ruta indicada?
+inline bool ruta_soportada(RutaSimd ruta) {
+#ifdef RUTAS_SIMD_X86
+    switch (ruta) {
+        case RutaSimd::SSE2: return __builtin_cpu_supports("sse2");
+        case RutaSimd::AVX2: return __builtin_cpu_supports("avx2");
+        default:             return true;
+    }
+#else
+    return ruta == RutaSimd::Escalar;
+#endif
+}
+
+// Mejor ruta disponible en la CPU actual
+inline RutaSimd detectar_ruta() {
+    if (ruta_soportada(RutaSimd::AVX2)) return RutaSimd::AVX2;
+    if (ruta_soportada(RutaSimd::SSE2)) return RutaSimd::SSE2;
+    return RutaSimd::Escalar;
+}
+
+#endif // RUTAS_SIMD_H
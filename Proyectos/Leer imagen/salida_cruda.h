@@ -0,0 +1,238 @@
+// salida_cruda.h - Salida sin comprimir: PGM (P5) y bytes crudos
+//
+// El gris ya está en memoria con el formato final, así que guardar es solo
+// copiarlo al fichero. Hay tres formas de hacerlo:
+//   - normal:   un único writev con la cabecera y el buffer gris, sin copias
+//               intermedias en espacio de usuario.
+//   - directa:  O_DIRECT, sin pasar por la caché de páginas. El núcleo exige
+//               buffer, desplazamiento y longitud alineados a bloque, así que
+//               los datos se copian por trozos a un buffer alineado y se
+//               escriben con pwrite; el último bloque se rellena y después
+//               el fichero se recorta a su tamaño real.
+//   - mapeada:  se reserva el espacio del fichero con posix_fallocate (si el
+//               disco se llena, falla aquí y no con SIGBUS durante la copia),
+//               se proyecta con mmap, se copia encima y msync(MS_SYNC) espera
+//               al volcado para poder informar de errores de escritura. Sin
+//               posix_fallocate (macOS) se escribe en modo normal.
+// Sin POSIX todas se reducen a fwrite.
+#ifndef SALIDA_CRUDA_H
+#define SALIDA_CRUDA_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SALIDA_POSIX 1
+#ifndef __APPLE__
+#define SALIDA_FALLOCATE 1
+#endif
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+enum class FormatoSalida { Jpeg, Pgm, Crudo };
+enum class ModoEscritura { Normal, Directa, Mapeada };
+
+inline const char* nombre_formato(FormatoSalida f) {
+    switch (f) {
+        case FormatoSalida::Pgm:   return "pgm";
+        case FormatoSalida::Crudo: return "raw";
+        default:                   return "jpg";
+    }
+}
+
+inline const char* nombre_escritura(ModoEscritura m) {
+    switch (m) {
+        case ModoEscritura::Directa: return "directa";
+        case ModoEscritura::Mapeada: return "mapeada";
+        default:                     return "normal";
+    }
+}
+
+// Formato según la extensión: .pgm, .raw o .gray; cualquier otra es JPEG
+inline FormatoSalida formato_por_extension(const std::string& ruta) {
+    const size_t punto = ruta.find_last_of('.');
+    if (punto == std::string::npos || ruta.find_first_of("/\\", punto) != std::string::npos) {
+        return FormatoSalida::Jpeg;
+    }
+    std::string ext = ruta.substr(punto);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == ".pgm") return FormatoSalida::Pgm;
+    if (ext == ".raw" || ext == ".gray") return FormatoSalida::Crudo;
+    return FormatoSalida::Jpeg;
+}
+
+inline std::string cabecera_pgm(int width, int height) {
+    return "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+}
+
+#ifdef SALIDA_POSIX
+
+// writev hasta escribirlo todo (puede volver con una escritura parcial)
+inline bool escribir_vector(int fd, iovec* partes, int n) {
+    while (n > 0) {
+        ssize_t escrito = ::writev(fd, partes, n);
+        if (escrito < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        size_t resto = static_cast<size_t>(escrito);
+        while (n > 0 && resto >= partes->iov_len) {
+            resto -= partes->iov_len;
+            ++partes;
+            --n;
+        }
+        if (n > 0) {
+            partes->iov_base = static_cast<char*>(partes->iov_base) + resto;
+            partes->iov_len -= resto;
+        }
+    }
+    return true;
+}
+
+inline bool escribir_en(int fd, const unsigned char* datos, size_t n, off_t desplazamiento) {
+    while (n > 0) {
+        ssize_t escrito = ::pwrite(fd, datos, n, desplazamiento);
+        if (escrito < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        datos += escrito;
+        n -= static_cast<size_t>(escrito);
+        desplazamiento += escrito;
+    }
+    return true;
+}
+
+inline bool escribir_normal(const std::string& ruta, const std::string& cabecera,
+                            const unsigned char* datos, size_t n) {
+    int fd = ::open(ruta.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    iovec partes[2] = {
+        {const_cast<char*>(cabecera.data()), cabecera.size()},
+        {const_cast<unsigned char*>(datos), n},
+    };
+    bool ok = cabecera.empty() ? escribir_vector(fd, partes + 1, 1) : escribir_vector(fd, partes, 2);
+    return ::close(fd) == 0 && ok;
+}
+
+#ifdef SALIDA_FALLOCATE
+
+inline bool escribir_mapeada(const std::string& ruta, const std::string& cabecera,
+                             const unsigned char* datos, size_t n) {
+    const size_t total = cabecera.size() + n;
+    int fd = ::open(ruta.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    if (total == 0) return ::close(fd) == 0;
+    // Bloques reservados, no un fichero disperso: sin espacio falla aquí
+    int error;
+    while ((error = ::posix_fallocate(fd, 0, static_cast<off_t>(total))) == EINTR) {}
+    if (error != 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = ::mmap(nullptr, total, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    auto* destino = static_cast<unsigned char*>(p);
+    std::memcpy(destino, cabecera.data(), cabecera.size());
+    std::memcpy(destino + cabecera.size(), datos, n);
+    const bool volcado = ::msync(p, total, MS_SYNC) == 0;
+    ::munmap(p, total);
+    return ::close(fd) == 0 && volcado;
+}
+
+#endif // SALIDA_FALLOCATE
+
+#ifdef O_DIRECT
+
+// Devuelve false con directa_no_soportada = true si el sistema de ficheros
+// rechaza O_DIRECT (tmpfs, por ejemplo), para poder repetir en modo normal
+inline bool escribir_directa(const std::string& ruta, const std::string& cabecera,
+                             const unsigned char* datos, size_t n, bool& directa_no_soportada) {
+    constexpr size_t ALINEACION = 4096;
+    constexpr size_t TROZO = 4 * 1024 * 1024;
+    directa_no_soportada = false;
+
+    int fd = ::open(ruta.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0) {
+        directa_no_soportada = errno == EINVAL;
+        return false;
+    }
+    void* memoria = nullptr;
+    if (posix_memalign(&memoria, ALINEACION, TROZO) != 0) {
+        ::close(fd);
+        return false;
+    }
+    auto* trozo = static_cast<unsigned char*>(memoria);
+
+    // El fichero es cabecera + datos; se recorre en trozos de TROZO bytes
+    const size_t total = cabecera.size() + n;
+    bool ok = true;
+    for (size_t desde = 0; ok && desde < total; desde += TROZO) {
+        const size_t lleno = std::min(TROZO, total - desde);
+        size_t pos = 0;
+        if (desde < cabecera.size()) {
+            pos = std::min(lleno, cabecera.size() - desde);
+            std::memcpy(trozo, cabecera.data() + desde, pos);
+        }
+        std::memcpy(trozo + pos, datos + (desde + pos - cabecera.size()), lleno - pos);
+        const size_t alineado = (lleno + ALINEACION - 1) / ALINEACION * ALINEACION;
+        std::memset(trozo + lleno, 0, alineado - lleno);
+        ok = escribir_en(fd, trozo, alineado, static_cast<off_t>(desde));
+        if (!ok && desde == 0 && errno == EINVAL) directa_no_soportada = true;
+    }
+    std::free(memoria);
+    if (ok) ok = ::ftruncate(fd, static_cast<off_t>(total)) == 0;
+    return ::close(fd) == 0 && ok;
+}
+
+#endif // O_DIRECT
+
+#endif // SALIDA_POSIX
+
+// Escribe gray como PGM o crudo. Si O_DIRECT o posix_fallocate no están
+// disponibles se escribe en modo normal y `modo` lo refleja.
+inline bool guardar_crudo(const std::string& ruta, const unsigned char* gray, int width, int height,
+                          FormatoSalida formato, ModoEscritura& modo) {
+    const std::string cabecera = formato == FormatoSalida::Pgm ? cabecera_pgm(width, height) : std::string();
+    const size_t n = static_cast<size_t>(width) * height;
+#ifdef SALIDA_POSIX
+    if (modo == ModoEscritura::Mapeada) {
+#ifdef SALIDA_FALLOCATE
+        return escribir_mapeada(ruta, cabecera, gray, n);
+#else
+        modo = ModoEscritura::Normal;
+#endif
+    }
+    if (modo == ModoEscritura::Directa) {
+#ifdef O_DIRECT
+        bool no_soportada = false;
+        const bool ok = escribir_directa(ruta, cabecera, gray, n, no_soportada);
+        if (!no_soportada) return ok;
+#endif
+        modo = ModoEscritura::Normal;
+    }
+    return escribir_normal(ruta, cabecera, gray, n);
+#else
+    modo = ModoEscritura::Normal;
+    std::FILE* f = std::fopen(ruta.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(cabecera.data(), 1, cabecera.size(), f) == cabecera.size() &&
+              std::fwrite(gray, 1, n, f) == n;
+    return std::fclose(f) == 0 && ok;
+#endif
+}
+
+#endif // SALIDA_CRUDA_H
@@ -1,55 +1,346 @@
 #include <iostream>
+#include <algorithm>
+#include <iomanip>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
 #include <immintrin.h>  // For SSE/AVX intrinsics
 
-constexpr size_t CACHE_LINE_SIZE = 64;  // AMD cache line size
+#include "accumulators.h"
+#include "benchmark.h"
+#include "parallel_reduce.h"   // also defines CACHE_LINE_SIZE
 
-void calculate_sums(uint64_t n, double& double_sum, long long& ll_sum) {
+enum class SimdPath { Scalar, AVX2, AVX512 };
+
+const char* path_name(SimdPath p) {
+    switch (p) {
+        case SimdPath::AVX2:   return "avx2";
+        case SimdPath::AVX512: return "avx512";
+        default:               return "scalar";
+    }
+}
+
+// CPUID check: AVX2 kernels also use FMA
+bool path_supported(SimdPath p) {
+    switch (p) {
+        case SimdPath::AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case SimdPath::AVX512: return __builtin_cpu_supports("avx512f");
+        default:               return true;
+    }
+}
+
+// Hand-written baseline: one dependent accumulator per sum, as originally
+// written. Only used to check the parallel_reduce version below against.
+void calculate_sums_hand(uint64_t n, double& double_sum, uint128& int_sum) {
     double_sum = 0.0;
-    ll_sum = 0;
-    
+    int_sum = 0;
+
     // Align memory for cache optimization
     alignas(CACHE_LINE_SIZE) double temp_double = 0.0;
-    alignas(CACHE_LINE_SIZE) long long temp_ll = 0;
-    
-    // Loop unrolling with 4-way parallelism
-    for (uint64_t i = 1; i <= n; i += 4) {
-        // Process 4 elements at a time
+    alignas(CACHE_LINE_SIZE) Int128Sum temp_int;
+
+    // Unrolled by 4, but every iteration still waits for the previous sum
+    uint64_t i = 1;
+    for (; i + 3 <= n; i += 4) {
         double d1 = static_cast<double>(i);
         double d2 = static_cast<double>(i+1);
         double d3 = static_cast<double>(i+2);
         double d4 = static_cast<double>(i+3);
-        
+
         temp_double += d1*d1 + d2*d2 + d3*d3 + d4*d4;
-        
-        long long ll1 = static_cast<long long>(i);
-        long long ll2 = static_cast<long long>(i+1);
-        long long ll3 = static_cast<long long>(i+2);
-        long long ll4 = static_cast<long long>(i+3);
-        
-        temp_ll += ll1*ll1 + ll2*ll2 + ll3*ll3 + ll4*ll4;
-    }
-    
+
+        temp_int.add_square(i);
+        temp_int.add_square(i+1);
+        temp_int.add_square(i+2);
+        temp_int.add_square(i+3);
+    }
+    for (; i <= n; ++i) {  // remainder when n is not a multiple of 4
+        temp_double += static_cast<double>(i) * static_cast<double>(i);
+        temp_int.add_square(i);
+    }
+
     double_sum = temp_double;
-    ll_sum = temp_ll;
-}
-
-int main() {
-    const uint64_t N = 100'000'000;  // 100 million
-    
-    double double_result;
-    long long ll_result;
-    
-    auto start = std::chrono::high_resolution_clock::now();
-    calculate_sums(N, double_result, ll_result);
-    auto end = std::chrono::high_resolution_clock::now();
-    
-    std::chrono::duration<double> duration = end - start;
-    
-    std::cout << "Single-threaded Results:\n";
-    std::cout << "Double sum: " << double_result << "\n";
-    std::cout << "Long long sum: " << ll_result << "\n";
-    std::cout << "Time: " << duration.count() << " seconds\n";
-    
+    int_sum = temp_int.value();
+}
+
+// Scalar path: the kernel as a map-reduce on the calling thread
+void calculate_sums_scalar(uint64_t n, double& double_sum, uint128& int_sum) {
+    const SquareSums s = parallel_reduce(Range{1, n}, SquareOf(), AddSums(), SquareSums{}, 1);
+    double_sum = s.double_sum;
+    int_sum = s.int_sum;
+}
+
+// The vector kernels keep 4 independent accumulators per sum so the FMA
+// and add latencies overlap. The int64 square uses the 32x32->64 bit
+// multiply (vpmuludq), exact while i < 2^32; anything above that, and the
+// final partial block, goes through the scalar code. The integer sum is a
+// WideSum per lane: a low word plus a high word counting its carries.
+constexpr uint64_t MAX_VECTOR_I = 0xFFFFFFFFull;
+
+__attribute__((target("avx2,fma")))
+void calculate_sums_avx2(uint64_t n, double& double_sum, uint128& int_sum) {
+    constexpr int LANES = 4, ACCS = 4, STEP = LANES * ACCS;
+    const uint64_t vector_n = std::min(n, MAX_VECTOR_I);
+    const uint64_t blocks = vector_n / STEP;
+
+    __m256d x[ACCS], dacc[ACCS];
+    __m256i xi[ACCS], lo[ACCS], hi[ACCS];
+    // AVX2 has no unsigned 64-bit compare: keep the low words offset by 2^63
+    // so the carry test (lo < square, unsigned) becomes a signed compare
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    for (int a = 0; a < ACCS; ++a) {
+        const double b = 1.0 + a * LANES;
+        x[a] = _mm256_setr_pd(b, b + 1, b + 2, b + 3);
+        xi[a] = _mm256_setr_epi64x(1 + a * LANES, 2 + a * LANES, 3 + a * LANES, 4 + a * LANES);
+        dacc[a] = _mm256_setzero_pd();
+        lo[a] = bias;
+        hi[a] = _mm256_setzero_si256();
+    }
+    const __m256d dstep = _mm256_set1_pd(STEP);
+    const __m256i istep = _mm256_set1_epi64x(STEP);
+
+    for (uint64_t b = 0; b < blocks; ++b) {
+        for (int a = 0; a < ACCS; ++a) {
+            dacc[a] = _mm256_fmadd_pd(x[a], x[a], dacc[a]);
+            const __m256i sq = _mm256_mul_epu32(xi[a], xi[a]);
+            lo[a] = _mm256_add_epi64(lo[a], sq);
+            hi[a] = _mm256_sub_epi64(hi[a], _mm256_cmpgt_epi64(_mm256_xor_si256(sq, bias), lo[a]));
+            x[a] = _mm256_add_pd(x[a], dstep);
+            xi[a] = _mm256_add_epi64(xi[a], istep);
+        }
+    }
+
+    __m256d dsum = _mm256_add_pd(_mm256_add_pd(dacc[0], dacc[1]), _mm256_add_pd(dacc[2], dacc[3]));
+    alignas(32) double d[LANES];
+    _mm256_store_pd(d, dsum);
+    double_sum = (d[0] + d[1]) + (d[2] + d[3]);
+    WideSum wide;
+    for (int a = 0; a < ACCS; ++a) {
+        alignas(32) uint64_t l[LANES], h[LANES];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(l), _mm256_xor_si256(lo[a], bias));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(h), hi[a]);
+        for (int k = 0; k < LANES; ++k) wide.merge(WideSum{l[k], h[k]});
+    }
+
+    Int128Sum tail;
+    for (uint64_t i = blocks * STEP + 1; i <= n; ++i) {
+        double_sum += static_cast<double>(i) * static_cast<double>(i);
+        tail.add_square(i);
+    }
+    int_sum = wide.value() + tail.value();
+}
+
+__attribute__((target("avx512f")))
+void calculate_sums_avx512(uint64_t n, double& double_sum, uint128& int_sum) {
+    constexpr int LANES = 8, ACCS = 4, STEP = LANES * ACCS;
+    const uint64_t vector_n = std::min(n, MAX_VECTOR_I);
+    const uint64_t blocks = vector_n / STEP;
+
+    __m512d x[ACCS], dacc[ACCS];
+    __m512i xi[ACCS], lo[ACCS], hi[ACCS];
+    for (int a = 0; a < ACCS; ++a) {
+        const int b = 1 + a * LANES;
+        xi[a] = _mm512_setr_epi64(b, b + 1, b + 2, b + 3, b + 4, b + 5, b + 6, b + 7);
+        x[a] = _mm512_setr_pd(b, b + 1, b + 2, b + 3, b + 4, b + 5, b + 6, b + 7);
+        dacc[a] = _mm512_setzero_pd();
+        lo[a] = _mm512_setzero_si512();
+        hi[a] = _mm512_setzero_si512();
+    }
+    const __m512d dstep = _mm512_set1_pd(STEP);
+    const __m512i istep = _mm512_set1_epi64(STEP);
+    const __m512i one = _mm512_set1_epi64(1);
+
+    for (uint64_t b = 0; b < blocks; ++b) {
+        for (int a = 0; a < ACCS; ++a) {
+            dacc[a] = _mm512_fmadd_pd(x[a], x[a], dacc[a]);
+            const __m512i sq = _mm512_mul_epu32(xi[a], xi[a]);
+            lo[a] = _mm512_add_epi64(lo[a], sq);
+            hi[a] = _mm512_mask_add_epi64(hi[a], _mm512_cmplt_epu64_mask(lo[a], sq), hi[a], one);
+            x[a] = _mm512_add_pd(x[a], dstep);
+            xi[a] = _mm512_add_epi64(xi[a], istep);
+        }
+    }
+
+    __m512d dsum = _mm512_add_pd(_mm512_add_pd(dacc[0], dacc[1]), _mm512_add_pd(dacc[2], dacc[3]));
+    alignas(64) double d[LANES];
+    _mm512_store_pd(d, dsum);
+    double_sum = ((d[0] + d[1]) + (d[2] + d[3])) + ((d[4] + d[5]) + (d[6] + d[7]));
+    WideSum wide;
+    for (int a = 0; a < ACCS; ++a) {
+        alignas(64) uint64_t l[LANES], h[LANES];
+        _mm512_store_si512(l, lo[a]);
+        _mm512_store_si512(h, hi[a]);
+        for (int k = 0; k < LANES; ++k) wide.merge(WideSum{l[k], h[k]});
+    }
+
+    Int128Sum tail;
+    for (uint64_t i = blocks * STEP + 1; i <= n; ++i) {
+        double_sum += static_cast<double>(i) * static_cast<double>(i);
+        tail.add_square(i);
+    }
+    int_sum = wide.value() + tail.value();
+}
+
+void calculate_sums(uint64_t n, double& double_sum, uint128& int_sum, SimdPath path) {
+    switch (path) {
+        case SimdPath::AVX512: calculate_sums_avx512(n, double_sum, int_sum); break;
+        case SimdPath::AVX2:   calculate_sums_avx2(n, double_sum, int_sum); break;
+        default:               calculate_sums_scalar(n, double_sum, int_sum); break;
+    }
+}
+
+// Kahan summation vectorized: 4 accumulators of 4 lanes, each lane with its
+// own compensation, merged at the end like per-thread partials
+__attribute__((target("avx2,fma")))
+double kahan_sum_avx2(uint64_t n) {
+    constexpr int LANES = 4, ACCS = 4, STEP = LANES * ACCS;
+    const uint64_t blocks = n / STEP;
+
+    __m256d x[ACCS], sum[ACCS], c[ACCS];
+    for (int a = 0; a < ACCS; ++a) {
+        const double b = 1.0 + a * LANES;
+        x[a] = _mm256_setr_pd(b, b + 1, b + 2, b + 3);
+        sum[a] = _mm256_setzero_pd();
+        c[a] = _mm256_setzero_pd();
+    }
+    const __m256d dstep = _mm256_set1_pd(STEP);
+
+    for (uint64_t b = 0; b < blocks; ++b) {
+        for (int a = 0; a < ACCS; ++a) {
+            const __m256d y = _mm256_fmsub_pd(x[a], x[a], c[a]);
+            const __m256d t = _mm256_add_pd(sum[a], y);
+            c[a] = _mm256_sub_pd(_mm256_sub_pd(t, sum[a]), y);
+            sum[a] = t;
+            x[a] = _mm256_add_pd(x[a], dstep);
+        }
+    }
+
+    KahanSum total;
+    for (int a = 0; a < ACCS; ++a) {
+        alignas(32) double s[LANES], e[LANES];
+        _mm256_store_pd(s, sum[a]);
+        _mm256_store_pd(e, c[a]);
+        for (int k = 0; k < LANES; ++k) total.merge(KahanSum{s[k], e[k]});
+    }
+    for (uint64_t i = blocks * STEP + 1; i <= n; ++i) total.add(static_cast<double>(i) * static_cast<double>(i));
+    return total.value();
+}
+
+// Measures fn(n) and prints its speed and its error against the exact sum
+template <class Fn>
+void report_accumulator(const char* name, uint64_t n, uint128 exact, Fn fn, const BenchOptions& opt,
+                        std::vector<BenchResult>& results) {
+    decltype(fn(n)) value{};
+    BenchResult b = measure(opt, [&] { value = fn(n); });
+    b.group = "accumulators";
+    b.name = name;
+    b.elements = n;
+    results.push_back(b);
+
+    const long double v = static_cast<long double>(value);
+    const long double e = static_cast<long double>(exact);
+    std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+              << std::setw(10) << std::setprecision(4) << b.median
+              << std::setw(10) << std::setprecision(1) << n / b.median / 1e6 << "   ";
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(3) << std::setw(10) << static_cast<double>((v > e ? v - e : e - v) / e)
+              << std::setprecision(6) << "   " << format_stats(b) << "\n";
+}
+
+// Usage: 001 [N] [--reps R] [--warmup W] [--no-counters] [--csv FILE] [--json FILE]
+int main(int argc, char* argv[]) {
+    const BenchOptions opt = parse_bench_options(argc, argv);
+    std::vector<BenchResult> results;
+    const uint64_t N = argc > 1 ? std::stoull(argv[1]) : 100'000'000;  // 100 million
+    const uint128 exact = exact_sum_of_squares(N);
+
+    std::cout << "Single-threaded Results (N = " << N << ", exact sum " << to_string(exact) << "; median of "
+              << opt.reps << " runs after " << opt.warmup << " warmup):\n";
+    std::cout << std::left << std::setw(8) << "path" << std::right << std::setw(12) << "time (s)"
+              << std::setw(14) << "Melem/s" << std::setw(10) << "GFLOP/s" << std::setw(10) << "speedup"
+              << "   ci95, kept runs, counters\n";
+
+    double base_time = 0.0, base_double = 0.0;
+    auto report_path = [&](const char* name, auto sums) {
+        double double_result;
+        uint128 int_result;
+        BenchResult b = measure(opt, [&] { sums(double_result, int_result); });
+        b.group = "paths";
+        b.name = name;
+        b.elements = N;
+        results.push_back(b);
+
+        const bool baseline = base_time == 0.0;
+        if (baseline) {
+            base_time = b.median;
+            base_double = double_result;
+        }
+        // Two floating-point operations per element: the square and the add
+        const double seconds = b.median;
+        std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+                  << std::setw(12) << std::setprecision(4) << seconds
+                  << std::setw(14) << std::setprecision(1) << N / seconds / 1e6
+                  << std::setw(10) << std::setprecision(2) << 2.0 * N / seconds / 1e9
+                  << std::setw(10) << base_time / seconds << "   " << format_stats(b) << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << "        sums " << std::setprecision(17) << double_result << " / " << to_string(int_result)
+                  << std::setprecision(6);
+        if (int_result != exact) std::cout << " (INTEGER SUM WRONG)";
+        if (!baseline) std::cout << " (double rel. diff " << std::abs(double_result - base_double) / base_double << ")";
+        std::cout << "\n";
+    };
+    report_path("hand", [&](double& d, uint128& i) { calculate_sums_hand(N, d, i); });
+    for (SimdPath path : {SimdPath::Scalar, SimdPath::AVX2, SimdPath::AVX512}) {
+        if (!path_supported(path)) {
+            std::cout << std::left << std::setw(8) << path_name(path) << std::right << "  (not supported by this CPU)\n";
+            continue;
+        }
+        report_path(path_name(path), [&](double& d, uint128& i) { calculate_sums(N, d, i, path); });
+    }
+
+    // Accumulators one by one (scalar unless named otherwise)
+    std::cout << "\nAccumulators:\n";
+    std::cout << std::left << std::setw(14) << "accumulator" << std::right << std::setw(10) << "time (s)"
+              << std::setw(10) << "Melem/s" << std::setw(13) << "rel. error" << "   ci95, kept runs, counters\n";
+    report_accumulator("long long", N, exact, [](uint64_t n) {
+        unsigned long long s = 0;   // wraps modulo 2^64 (long long itself would be UB)
+        for (uint64_t i = 1; i <= n; ++i) s += static_cast<unsigned long long>(i) * i;
+        return s;
+    }, opt, results);
+    report_accumulator("int128", N, exact, [](uint64_t n) {
+        Int128Sum s;
+        for (uint64_t i = 1; i <= n; ++i) s.add_square(i);
+        return s.value();
+    }, opt, results);
+    report_accumulator("wide 2x64", N, exact, [](uint64_t n) {
+        WideSum s;
+        for (uint64_t i = 1; i <= n; ++i) s.add_square(i);
+        return s.value();
+    }, opt, results);
+    report_accumulator("double", N, exact, [](uint64_t n) {
+        double s = 0.0;
+        for (uint64_t i = 1; i <= n; ++i) s += static_cast<double>(i) * static_cast<double>(i);
+        return s;
+    }, opt, results);
+    report_accumulator("kahan", N, exact, [](uint64_t n) {
+        KahanSum s;
+        for (uint64_t i = 1; i <= n; ++i) s.add(static_cast<double>(i) * static_cast<double>(i));
+        return s.value();
+    }, opt, results);
+    report_accumulator("neumaier", N, exact, [](uint64_t n) {
+        NeumaierSum s;
+        for (uint64_t i = 1; i <= n; ++i) s.add(static_cast<double>(i) * static_cast<double>(i));
+        return s.value();
+    }, opt, results);
+    report_accumulator("pairwise", N, exact, [](uint64_t n) {
+        PairwiseSum s;
+        for (uint64_t i = 1; i <= n; ++i) s.add(static_cast<double>(i) * static_cast<double>(i));
+        return s.value();
+    }, opt, results);
+    if (path_supported(SimdPath::AVX2)) report_accumulator("kahan avx2", N, exact, kahan_sum_avx2, opt, results);
+
+    write_bench_files(opt, results);
     return 0;
-}
\ No newline at end of file
+}
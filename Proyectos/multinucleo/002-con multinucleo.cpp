@@ -1,65 +1,302 @@
 #include <iostream>
+#include <algorithm>
+#include <iomanip>
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
 #include <immintrin.h>  // For SSE/AVX intrinsics
 
-constexpr size_t CACHE_LINE_SIZE = 64;  // AMD cache line size
+#include "accumulators.h"
+#include "benchmark.h"
+#include "parallel_reduce.h"
+#include "topology.h"
+#include "work_stealing.h"
 
-// Thread-safe accumulators with cache alignment
-struct alignas(CACHE_LINE_SIZE) ThreadData {
+struct RunResult {
     double double_sum = 0.0;
-    long long ll_sum = 0;
+    uint128 int_sum = 0;
+    double seconds = 0.0;
+    StealStats stats;
+};
+
+template <class Reduce>
+RunResult timed_reduce(Reduce reduce) {
+    RunResult r;
+    auto start = std::chrono::high_resolution_clock::now();
+    const ReduceResult<SquareSums> s = reduce();
+    auto end = std::chrono::high_resolution_clock::now();
+    r.double_sum = s.value.double_sum;
+    r.int_sum = s.value.int_sum;
+    r.stats = s.stats;
+    r.seconds = std::chrono::duration<double>(end - start).count();
+    return r;
+}
+
+// Sum of squares of 1..n through parallel_reduce on `threads` workers placed
+// by `policy`; each worker allocates its own accumulator after pinning, so
+// it is local to the worker's node
+RunResult parallel_sum(uint64_t n, unsigned threads, uint64_t chunk, Placement policy,
+                       const std::vector<CpuInfo>& topology) {
+    const std::vector<int> cpus = placement_cpus(topology, policy, threads);
+    AffinityGuard caller_affinity;   // worker 0 is this thread
+    return timed_reduce([&] {
+        return parallel_reduce_stats(Range{1, n}, SquareOf(), AddSums(), SquareSums{}, threads, chunk, [&](unsigned w) {
+            if (!cpus.empty()) pin_current_thread(cpus[w]);
+        });
+    });
+}
+
+// Same sum on the persistent workers of `pool`
+RunResult parallel_sum(ThreadPool& pool, uint64_t n, uint64_t chunk) {
+    return timed_reduce([&] { return parallel_reduce_stats(pool, Range{1, n}, SquareOf(), AddSums(), SquareSums{}, chunk); });
+}
+
+// Hand-written version, kept as the baseline parallel_reduce is checked
+// against: thread-safe accumulators with cache alignment
+struct alignas(CACHE_LINE_SIZE) ThreadData {
+    NeumaierSum double_sum;
+    Int128Sum int_sum;
 };
 
+// Adds the squares of [start, end] to data (called once per chunk). Within a
+// chunk the double sum is plain; the chunk totals go through Neumaier, so the
+// rounding error grows with the chunk size rather than with n.
 void partial_sum(uint64_t start, uint64_t end, ThreadData& data) {
     double local_double = 0.0;
-    long long local_ll = 0;
-    
-    // Process 2 elements per iteration (optimized for dual-core)
-    for (uint64_t i = start; i <= end; i += 2) {
+    Int128Sum local_int;
+
+    // Process 2 elements per iteration
+    uint64_t i = start;
+    for (; i + 1 <= end; i += 2) {
         // Double calculations
         double d1 = static_cast<double>(i);
         double d2 = static_cast<double>(i+1);
         local_double += d1*d1 + d2*d2;
-        
-        // Long long calculations
-        long long ll1 = static_cast<long long>(i);
-        long long ll2 = static_cast<long long>(i+1);
-        local_ll += ll1*ll1 + ll2*ll2;
+
+        // 128-bit integer calculations
+        local_int.add_square(i);
+        local_int.add_square(i+1);
     }
-    
-    data.double_sum = local_double;
-    data.ll_sum = local_ll;
+    if (i == end) {  // odd-sized chunk
+        local_double += static_cast<double>(i) * static_cast<double>(i);
+        local_int.add_square(i);
+    }
+
+    data.double_sum.add(local_double);
+    data.int_sum.merge(local_int);
 }
 
-int main() {
-    const uint64_t N = 100'000'000;  // 100 million
-    
-    // Aligned thread data to prevent false sharing
-    alignas(CACHE_LINE_SIZE) ThreadData data1;
-    alignas(CACHE_LINE_SIZE) ThreadData data2;
-    
+// run(body, start) drives the chunks; each worker creates its own ThreadData
+// in start, so it is first touched on the worker's node
+template <class Run>
+RunResult hand_sum(unsigned threads, Run run) {
+    RunResult r;
     auto start = std::chrono::high_resolution_clock::now();
-    
-    // Split work between two cores
-    std::thread t1(partial_sum, 1, N/2, std::ref(data1));
-    std::thread t2(partial_sum, N/2 + 1, N, std::ref(data2));
-    
-    t1.join();
-    t2.join();
-    
+    std::vector<LocalBuffer<ThreadData>> data(threads);
+    r.stats = run([&](unsigned w, uint64_t first, uint64_t last) { partial_sum(first, last, *data[w].get()); },
+                  [&](unsigned w) { data[w].create(); });
+
     // Combine results
-    double double_result = data1.double_sum + data2.double_sum;
-    long long ll_result = data1.ll_sum + data2.ll_sum;
-    
+    NeumaierSum double_total;
+    Int128Sum int_total;
+    for (const LocalBuffer<ThreadData>& d : data) {
+        if (!d.get()) continue;
+        double_total.merge(d.get()->double_sum);
+        int_total.merge(d.get()->int_sum);
+    }
+    r.double_sum = double_total.value();
+    r.int_sum = int_total.value();
     auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> duration = end - start;
-    
-    std::cout << "Dual-threaded Results:\n";
-    std::cout << "Double sum: " << double_result << "\n";
-    std::cout << "Long long sum: " << ll_result << "\n";
-    std::cout << "Time: " << duration.count() << " seconds\n";
-    
+    r.seconds = std::chrono::duration<double>(end - start).count();
+    return r;
+}
+
+RunResult parallel_sum_hand(uint64_t n, unsigned threads, uint64_t chunk) {
+    return hand_sum(threads, [&](auto body, auto init) { return parallel_for_chunks(threads, 1, n, chunk, body, init); });
+}
+
+RunResult parallel_sum_hand(ThreadPool& pool, uint64_t n, uint64_t chunk) {
+    return hand_sum(pool.size(), [&](auto body, auto init) { return parallel_for_chunks(pool, 1, n, chunk, body, init); });
+}
+
+std::string describe_cpus(const std::vector<int>& cpus) {
+    if (cpus.empty()) return "unpinned";
+    std::string s;
+    for (size_t i = 0; i < cpus.size() && i < 16; ++i) s += (i ? "," : "") + std::to_string(cpus[i]);
+    return cpus.size() > 16 ? s + ",..." : s;
+}
+
+// Usage: 002 [N] [max_threads] [chunk] [none|pack|spread]
+//            [--reps R] [--warmup W] [--no-counters] [--csv FILE] [--json FILE]
+int main(int argc, char* argv[]) {
+    const BenchOptions opt = parse_bench_options(argc, argv);
+    std::vector<BenchResult> results;
+    const uint64_t N = argc > 1 ? std::stoull(argv[1]) : 100'000'000;  // 100 million
+    const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned max_threads = argc > 2 ? std::max(1, std::stoi(argv[2])) : hw;
+    const uint64_t chunk = argc > 3 ? std::stoull(argv[3]) : 1 << 16;
+    const std::string policy_arg = argc > 4 ? argv[4] : "none";
+    const Placement policy = policy_arg == "pack" ? Placement::Pack
+                           : policy_arg == "spread" ? Placement::Spread : Placement::None;
+
+    // Measures fn() with opt and files the row under group/name
+    auto bench = [&](const BenchOptions& o, const char* group, const std::string& name, unsigned threads,
+                     uint64_t elements, auto fn) {
+        BenchResult b = measure(o, fn);
+        b.group = group;
+        b.name = name;
+        b.threads = threads;
+        b.elements = elements;
+        results.push_back(b);
+        return b;
+    };
+
+    const std::vector<CpuInfo> topology = read_topology();
+    std::cout << "Topology: " << topology.size() << " usable CPUs, "
+              << count_distinct(topology, &CpuInfo::core) << " cores, "
+              << count_distinct(topology, &CpuInfo::l3) << " L3 groups, "
+              << count_distinct(topology, &CpuInfo::node) << " NUMA nodes\n";
+
+    // 1, 2, 4, ... threads, plus max_threads itself if it is not a power of two
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+
+    std::cout << "Parallel sum of squares, N = " << N << ", chunk = " << chunk
+              << " elements, hardware threads = " << hw << ", placement = " << placement_name(policy)
+              << "\nTimes are medians of " << opt.reps << " runs after " << opt.warmup << " warmup\n\n";
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "time (s)" << std::setw(10) << "speedup"
+              << std::setw(12) << "efficiency" << std::setw(10) << "chunks" << std::setw(10) << "stolen"
+              << "   ci95, kept runs, counters\n";
+
+    const std::streamsize precision = std::cout.precision();
+    RunResult base;
+    double base_seconds = 0.0;
+    for (unsigned t : counts) {
+        RunResult r;
+        const BenchResult b = bench(opt, "scaling", "threads=" + std::to_string(t), t, N,
+                                    [&] { r = parallel_sum(N, t, chunk, policy, topology); });
+        if (t == 1) {
+            base = r;
+            base_seconds = b.median;
+        }
+        const double speedup = base_seconds / b.median;
+        std::cout << std::setw(8) << t << std::setw(12) << std::fixed << std::setprecision(4) << b.median
+                  << std::setw(10) << std::setprecision(2) << speedup
+                  << std::setw(11) << std::setprecision(0) << 100.0 * speedup / t << "%"
+                  << std::setw(10) << r.stats.chunks << std::setw(10) << r.stats.steals << "   " << format_stats(b) << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout.precision(precision);
+        if (r.int_sum != base.int_sum) std::cout << "  (integer sum differs from the 1-thread run!)\n";
+    }
+
+    // Same thread count, each placement policy
+    std::cout << "\nPlacement at " << max_threads << " threads:\n";
+    std::cout << std::left << std::setw(8) << "policy" << std::right << std::setw(12) << "time (s)"
+              << std::setw(10) << "vs none" << "   ci95, kept runs, counters        cpus\n";
+    double none_seconds = 0.0;
+    for (Placement p : {Placement::None, Placement::Pack, Placement::Spread}) {
+        const BenchResult b = bench(opt, "placement", placement_name(p), max_threads, N,
+                                    [&] { parallel_sum(N, max_threads, chunk, p, topology); });
+        if (p == Placement::None) none_seconds = b.median;
+        std::cout << std::left << std::setw(8) << placement_name(p) << std::right << std::fixed
+                  << std::setw(12) << std::setprecision(4) << b.median
+                  << std::setw(10) << std::setprecision(2) << none_seconds / b.median << "   "
+                  << format_stats(b) << "   " << describe_cpus(placement_cpus(topology, p, max_threads)) << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout.precision(precision);
+    }
+
+    // Small reductions: thread creation per run against the persistent pool,
+    // spinning before parking and parking at once. The caller is worker 0 of
+    // the pools, so it is pinned to cpus[0] only while the pool rows run:
+    // threads spawned by the spawn rows would inherit a one-CPU mask.
+    {
+        const std::vector<int> cpus = placement_cpus(topology, policy, max_threads);
+        auto pin = [&](unsigned w) {
+            if (!cpus.empty()) pin_current_thread(cpus[w]);
+        };
+        ThreadPool spinning(max_threads, DEFAULT_SPIN_ITERATIONS, pin);
+        ThreadPool parking(max_threads, 0, pin);
+
+        std::cout << "\nDispatch-to-result latency at " << max_threads << " threads (median):\n";
+        std::cout << std::setw(10) << "N" << std::setw(14) << "spawn (us)" << std::setw(14) << "pool (us)"
+                  << std::setw(14) << "park (us)" << std::setw(10) << "speedup" << "   pool ci95, kept runs, counters\n";
+        for (uint64_t n : {1'000ull, 10'000ull, 100'000ull, 1'000'000ull}) {
+            const uint64_t small_chunk = std::max<uint64_t>(1024, std::min<uint64_t>(chunk, n / (4 * max_threads)));
+            // Short runs are cheap and noisy: many more repetitions than the big tables
+            BenchOptions o = opt;
+            o.reps = static_cast<int>(std::clamp<uint64_t>(100'000'000 / n, 21, 1001));
+            o.warmup = std::max(o.warmup, 10);
+            BenchOptions o_pool = o;
+            o_pool.counters = false;   // inherit misses the pool's workers (see benchmark.h)
+            const std::string size = std::to_string(n);
+            const BenchResult spawn = bench(o, "latency", "spawn n=" + size, max_threads, n, [&] {
+                parallel_sum(n, max_threads, small_chunk, Placement::None, topology);
+            });
+            BenchResult pooled, parked;
+            {
+                AffinityGuard caller_affinity;
+                if (!cpus.empty()) pin_current_thread(cpus[0]);
+                pooled = bench(o_pool, "latency", "pool n=" + size, max_threads, n,
+                               [&] { parallel_sum(spinning, n, small_chunk); });
+                parked = bench(o_pool, "latency", "park n=" + size, max_threads, n,
+                               [&] { parallel_sum(parking, n, small_chunk); });
+            }
+            std::cout << std::setw(10) << n << std::fixed << std::setprecision(1)
+                      << std::setw(14) << spawn.median * 1e6 << std::setw(14) << pooled.median * 1e6
+                      << std::setw(14) << parked.median * 1e6
+                      << std::setw(10) << std::setprecision(2) << spawn.median / pooled.median << "   "
+                      << format_stats(pooled) << "\n";
+            std::cout.unsetf(std::ios::fixed);
+            std::cout.precision(precision);
+        }
+    }
+
+    // Hand-written partial_sum against the generic parallel_reduce
+    {
+        ThreadPool pool(max_threads);
+        BenchOptions opt_pool = opt;
+        opt_pool.counters = false;
+        RunResult hand, hand_pool, generic, generic_pool;
+        const BenchResult b_hand = bench(opt, "reduce", "hand/threads", max_threads, N,
+                                         [&] { hand = parallel_sum_hand(N, max_threads, chunk); });
+        const BenchResult b_generic = bench(opt, "reduce", "reduce/threads", max_threads, N,
+                                            [&] { generic = parallel_sum(N, max_threads, chunk, Placement::None, topology); });
+        const BenchResult b_hand_pool = bench(opt_pool, "reduce", "hand/pool", max_threads, N,
+                                              [&] { hand_pool = parallel_sum_hand(pool, N, chunk); });
+        const BenchResult b_generic_pool = bench(opt_pool, "reduce", "reduce/pool", max_threads, N,
+                                                 [&] { generic_pool = parallel_sum(pool, N, chunk); });
+
+        std::cout << "\nHand-written vs parallel_reduce at " << max_threads << " threads:\n";
+        std::cout << std::left << std::setw(18) << "version" << std::right << std::setw(12) << "time (s)"
+                  << std::setw(12) << "Melem/s" << std::setw(10) << "vs hand" << "   sum    ci95, kept runs, counters\n";
+        auto row = [&](const BenchResult& b, const RunResult& r, const BenchResult& ref) {
+            std::cout << std::left << std::setw(18) << b.name << std::right << std::fixed
+                      << std::setw(12) << std::setprecision(4) << b.median
+                      << std::setw(12) << std::setprecision(1) << N / b.median / 1e6
+                      << std::setw(10) << std::setprecision(2) << ref.median / b.median << "   "
+                      << (r.int_sum == hand.int_sum ? "same   " : "DIFFERS") << format_stats(b) << "\n";
+            std::cout.unsetf(std::ios::fixed);
+            std::cout.precision(precision);
+        };
+        row(b_hand, hand, b_hand);
+        row(b_generic, generic, b_hand);
+        row(b_hand_pool, hand_pool, b_hand_pool);
+        row(b_generic_pool, generic_pool, b_hand_pool);
+    }
+
+    const uint128 exact = exact_sum_of_squares(N);
+    const long double exact_ld = static_cast<long double>(exact);
+    std::cout << "\nResults:\n";
+    std::cout << "Double sum: " << std::setprecision(17) << base.double_sum << std::setprecision(6)
+              << " (rel. error " << static_cast<double>(std::abs(base.double_sum - exact_ld) / exact_ld) << ")\n";
+    std::cout << "Integer sum: " << to_string(base.int_sum)
+              << (base.int_sum == exact ? " (exact)" : " (WRONG, exact is " + to_string(exact) + ")") << "\n";
+
+    write_bench_files(opt, results);
     return 0;
-}
\ No newline at end of file
+}
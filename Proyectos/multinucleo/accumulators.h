@@ -0,0 +1,174 @@
+// accumulators.h - Overflow-safe integer and compensated floating-point sums
+//
+// The sum of squares up to N = 1e8 is about 3.3e23, far past the 9.2e18 a
+// long long holds, and a plain double sum loses low bits as it grows.
+//
+// Integer:
+//   - Int128Sum: unsigned __int128, one add/adc pair per term.
+//   - WideSum:   two 64-bit words with an explicit carry. This is the form
+//                the vector kernels keep per lane (there are no 128-bit lanes).
+// Floating point:
+//   - KahanSum:    carries the rounding error of each add into the next one.
+//   - NeumaierSum: Kahan variant that stays exact when a term is larger than
+//                  the running sum.
+//   - PairwiseSum: plain sums of PAIRWISE_BLOCK terms combined as a binary
+//                  tree, so the error grows with log(n) instead of n.
+//
+// Every accumulator has add() for one term, merge() to combine per-thread or
+// per-lane partials, and value().
+#ifndef ACCUMULATORS_H
+#define ACCUMULATORS_H
+
+#include <cstdint>
+#include <string>
+
+__extension__ typedef unsigned __int128 uint128;
+
+// n(n+1)(2n+1)/6, exact for n < 2^42
+inline uint128 exact_sum_of_squares(uint64_t n) {
+    return uint128(n) * (n + 1) * (2 * uint128(n) + 1) / 6;
+}
+
+// The benchmark's kernel in parallel_reduce form: map i to (i^2 as double,
+// i^2 exact) and add pairs
+struct SquareSums {
+    double double_sum = 0.0;
+    uint128 int_sum = 0;
+};
+
+struct SquareOf {
+    SquareSums operator()(uint64_t i) const {
+        const double d = static_cast<double>(i);
+        return SquareSums{d * d, uint128(i) * i};
+    }
+};
+
+struct AddSums {
+    SquareSums operator()(const SquareSums& a, const SquareSums& b) const {
+        return SquareSums{a.double_sum + b.double_sum, a.int_sum + b.int_sum};
+    }
+};
+
+inline std::string to_string(uint128 v) {
+    if (v == 0) return "0";
+    std::string s;
+    for (; v != 0; v /= 10) s.insert(s.begin(), char('0' + int(v % 10)));
+    return s;
+}
+
+struct Int128Sum {
+    uint128 sum = 0;
+
+    void add(uint128 x) { sum += x; }
+    void add_square(uint64_t i) { sum += uint128(i) * i; }
+    void merge(const Int128Sum& o) { sum += o.sum; }
+    uint128 value() const { return sum; }
+};
+
+struct WideSum {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    void add(uint64_t x) {
+        lo += x;
+        hi += lo < x;   // carry out of the low word
+    }
+    void add_square(uint64_t i) {
+        const uint128 sq = uint128(i) * i;
+        add(static_cast<uint64_t>(sq));
+        hi += static_cast<uint64_t>(sq >> 64);
+    }
+    void merge(const WideSum& o) {
+        add(o.lo);
+        hi += o.hi;
+    }
+    uint128 value() const { return (uint128(hi) << 64) | lo; }
+};
+
+struct KahanSum {
+    double sum = 0.0;
+    double c = 0.0;   // low-order bits lost by the last add (negated)
+
+    void add(double x) {
+        const double y = x - c;
+        const double t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+    void merge(const KahanSum& o) {
+        add(o.sum);
+        add(-o.c);
+    }
+    double value() const { return sum - c; }
+};
+
+struct NeumaierSum {
+    double sum = 0.0;
+    double c = 0.0;   // accumulated low-order bits
+
+    void add(double x) {
+        const double t = sum + x;
+        if (__builtin_fabs(sum) >= __builtin_fabs(x)) c += (sum - t) + x;
+        else c += (x - t) + sum;
+        sum = t;
+    }
+    void merge(const NeumaierSum& o) {
+        add(o.sum);
+        c += o.c;
+    }
+    double value() const { return sum + c; }
+};
+
+constexpr int PAIRWISE_BLOCK = 128;
+
+// Binary counter of block sums: level k holds the sum of 2^k full blocks,
+// so only partials of similar size are ever added together
+class PairwiseSum {
+public:
+    void add(double x) {
+        block_ += x;
+        if (++count_ == PAIRWISE_BLOCK) {
+            push(block_, 0);
+            block_ = 0.0;
+            count_ = 0;
+        }
+    }
+
+    void merge(const PairwiseSum& o) {
+        for (int k = 0; k < LEVELS; ++k)
+            if (o.used_ >> k & 1) push(o.level_[k], k);
+        block_ += o.block_;
+        count_ += o.count_;
+        if (count_ >= PAIRWISE_BLOCK) {
+            push(block_, 0);
+            block_ = 0.0;
+            count_ = 0;
+        }
+    }
+
+    double value() const {
+        double s = block_;
+        for (int k = 0; k < LEVELS; ++k)
+            if (used_ >> k & 1) s += level_[k];
+        return s;
+    }
+
+private:
+    static constexpr int LEVELS = 64;
+
+    void push(double v, int k) {
+        for (; used_ >> k & 1; ++k) {
+            v += level_[k];
+            used_ &= ~(uint64_t(1) << k);
+        }
+        level_[k] = v;
+        used_ |= uint64_t(1) << k;
+    }
+
+    double level_[LEVELS];
+    uint64_t used_ = 0;   // bit k set when level_[k] holds a partial
+    double block_ = 0.0;
+    int count_ = 0;
+};
+
+#endif // ACCUMULATORS_H
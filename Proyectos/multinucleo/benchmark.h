@@ -0,0 +1,314 @@
+// benchmark.h - Repeated timing with statistics and hardware counters
+//
+// One timed run swings by +-30% with turbo, cold caches and noise, so every
+// measurement here is:
+//   1. `warmup` untimed runs (caches, page faults, clocks ramping up);
+//   2. `reps` timed runs, each also counting cycles, instructions and
+//      cache references/misses through perf_event_open when the kernel
+//      allows it (Linux only; perf_event_paranoid, containers);
+//   3. Tukey outlier rejection: runs outside [Q1 - 1.5 IQR, Q3 + 1.5 IQR]
+//      are dropped;
+//   4. mean, median, standard deviation and a 95% confidence interval
+//      (Student's t) of the runs that remain, with the counters averaged
+//      over the same runs.
+// Results go to stdout through the programs' own tables and, on request,
+// to CSV and JSON files.
+//
+// Counters are opened with `inherit`, so they follow the calling thread and
+// every thread it creates during the run. Threads that already existed
+// (a ThreadPool's workers) are not counted: their rows would show only the
+// caller's share of the work, so they are measured with `counters` off and
+// report n/a (null in CSV/JSON) instead.
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    int warmup = 1;
+    int reps = 5;
+    bool counters = true;
+    std::string csv;    // empty: no file
+    std::string json;
+};
+
+// Takes --warmup N, --reps N, --no-counters, --csv FILE and --json FILE
+// out of argv and leaves the positional arguments in place
+inline BenchOptions parse_bench_options(int& argc, char* argv[]) {
+    BenchOptions o;
+    int out = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (a == "--warmup" && has_value) o.warmup = std::max(0, std::atoi(argv[++i]));
+        else if (a == "--reps" && has_value) o.reps = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--csv" && has_value) o.csv = argv[++i];
+        else if (a == "--json" && has_value) o.json = argv[++i];
+        else if (a == "--no-counters") o.counters = false;
+        else argv[out++] = argv[i];
+    }
+    argc = out;
+    return o;
+}
+
+enum Counter { CYCLES, INSTRUCTIONS, CACHE_REFERENCES, CACHE_MISSES, COUNTERS };
+
+// One perf event per counter, enabled only around each timed run; none
+// available off Linux
+class PerfCounters {
+public:
+    explicit PerfCounters(bool enabled) {
+        for (int& fd : fd_) fd = -1;
+#ifdef __linux__
+        static const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                   PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+        for (int c = 0; c < COUNTERS; ++c) {
+            if (!enabled) continue;
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[c];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_[c] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#else
+        (void)enabled;
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fd_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(Counter c) const { return fd_[c] >= 0; }
+
+    void start() {
+#ifdef __linux__
+        for (int fd : fd_) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    void stop(double values[COUNTERS]) {
+        for (int c = 0; c < COUNTERS; ++c) {
+            values[c] = 0.0;
+#ifdef __linux__
+            if (fd_[c] < 0) continue;
+            ioctl(fd_[c], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t v = 0;
+            if (read(fd_[c], &v, sizeof(v)) == sizeof(v)) values[c] = static_cast<double>(v);
+#endif
+        }
+    }
+
+private:
+    int fd_[COUNTERS];
+};
+
+struct BenchResult {
+    std::string group;      // which table the row belongs to
+    std::string name;
+    uint64_t elements = 0;
+    unsigned threads = 1;
+
+    int reps = 0;
+    int kept = 0;           // runs left after outlier rejection
+    double mean = 0.0, median = 0.0, stddev = 0.0, min = 0.0, max = 0.0;
+    double ci95 = 0.0;      // half width of the 95% confidence interval of the mean
+    bool has_counter[COUNTERS] = {};
+    double counter[COUNTERS] = {};   // mean per kept run
+
+    double ipc() const { return counter[CYCLES] > 0 ? counter[INSTRUCTIONS] / counter[CYCLES] : 0.0; }
+    double miss_rate() const {
+        return counter[CACHE_REFERENCES] > 0 ? counter[CACHE_MISSES] / counter[CACHE_REFERENCES] : 0.0;
+    }
+};
+
+// Two-sided 97.5% quantile of Student's t
+inline double t_quantile(int df) {
+    static const double table[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                     2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                     2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1) return 0.0;
+    if (df <= 30) return table[df - 1];
+    return df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+// Quantile of sorted values by linear interpolation
+inline double quantile(const std::vector<double>& sorted, double q) {
+    const double pos = q * (sorted.size() - 1);
+    const size_t lo = static_cast<size_t>(pos);
+    const size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+// Runs fn() warmup + reps times and summarizes the timed runs
+template <class Fn>
+BenchResult measure(const BenchOptions& opt, Fn fn) {
+    for (int i = 0; i < opt.warmup; ++i) fn();
+
+    PerfCounters perf(opt.counters);
+    std::vector<double> times(opt.reps);
+    std::vector<std::array<double, COUNTERS>> counts(opt.reps);
+    for (int r = 0; r < opt.reps; ++r) {
+        perf.start();
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        perf.stop(counts[r].data());
+        times[r] = std::chrono::duration<double>(end - start).count();
+    }
+
+    BenchResult b;
+    b.reps = opt.reps;
+    for (int c = 0; c < COUNTERS; ++c) b.has_counter[c] = perf.available(static_cast<Counter>(c));
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    const double q1 = quantile(sorted, 0.25), q3 = quantile(sorted, 0.75);
+    const double low = q1 - 1.5 * (q3 - q1), high = q3 + 1.5 * (q3 - q1);
+
+    std::vector<double> kept;
+    for (int r = 0; r < opt.reps; ++r) {
+        if (times[r] < low || times[r] > high) continue;
+        kept.push_back(times[r]);
+        for (int c = 0; c < COUNTERS; ++c) b.counter[c] += counts[r][c];
+    }
+    b.kept = static_cast<int>(kept.size());
+    for (double& v : b.counter) v /= b.kept;
+
+    std::sort(kept.begin(), kept.end());
+    b.min = kept.front();
+    b.max = kept.back();
+    b.median = quantile(kept, 0.5);
+    for (double t : kept) b.mean += t;
+    b.mean /= b.kept;
+    for (double t : kept) b.stddev += (t - b.mean) * (t - b.mean);
+    b.stddev = b.kept > 1 ? std::sqrt(b.stddev / (b.kept - 1)) : 0.0;
+    b.ci95 = b.kept > 1 ? t_quantile(b.kept - 1) * b.stddev / std::sqrt(static_cast<double>(b.kept)) : 0.0;
+    return b;
+}
+
+// Spread, sample count and counters in one column block for the tables
+inline std::string format_stats(const BenchResult& b) {
+    char text[128];
+    int n = std::snprintf(text, sizeof(text), "+-%5.1f%% %3d/%-3d", b.mean > 0 ? 100.0 * b.ci95 / b.mean : 0.0,
+                          b.kept, b.reps);
+    if (b.has_counter[CYCLES] && b.has_counter[INSTRUCTIONS])
+        n += std::snprintf(text + n, sizeof(text) - n, "  IPC %4.2f", b.ipc());
+    else
+        n += std::snprintf(text + n, sizeof(text) - n, "  IPC  n/a");
+    if (b.has_counter[CACHE_REFERENCES] && b.has_counter[CACHE_MISSES])
+        std::snprintf(text + n, sizeof(text) - n, "  miss %5.1f%%", 100.0 * b.miss_rate());
+    return text;
+}
+
+inline const char* counter_name(int c) {
+    static const char* names[COUNTERS] = {"cycles", "instructions", "cache_references", "cache_misses"};
+    return names[c];
+}
+
+// CSV text field per RFC 4180: always quoted, embedded quotes doubled
+inline std::string csv_field(const std::string& text) {
+    std::string q = "\"";
+    for (char ch : text) q += ch == '"' ? std::string("\"\"") : std::string(1, ch);
+    return q + "\"";
+}
+
+// JSON string literal; the names here are plain text, so only quotes,
+// backslashes and control characters need escaping
+inline std::string json_string(const std::string& text) {
+    std::string q = "\"";
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') q += '\\';
+        if (static_cast<unsigned char>(ch) < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", ch);
+            q += esc;
+        } else {
+            q += ch;
+        }
+    }
+    return q + "\"";
+}
+
+inline bool write_csv(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "group,name,elements,threads,reps,kept,mean_s,median_s,stddev_s,min_s,max_s,ci95_s,ipc";
+    for (int c = 0; c < COUNTERS; ++c) out << ',' << counter_name(c);
+    out << '\n';
+    out.precision(9);
+    for (const BenchResult& b : results) {
+        out << csv_field(b.group) << ',' << csv_field(b.name) << ',' << b.elements << ',' << b.threads << ',' << b.reps << ',' << b.kept
+            << ',' << b.mean << ',' << b.median << ',' << b.stddev << ',' << b.min << ',' << b.max << ',' << b.ci95
+            << ',';
+        if (b.has_counter[CYCLES] && b.has_counter[INSTRUCTIONS]) out << b.ipc();
+        for (int c = 0; c < COUNTERS; ++c) {
+            out << ',';
+            if (b.has_counter[c]) out << static_cast<uint64_t>(b.counter[c]);
+        }
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+inline bool write_json(const std::string& path, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out.precision(9);
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& b = results[i];
+        out << "  {\"group\": " << json_string(b.group) << ", \"name\": " << json_string(b.name) << ", \"elements\": " << b.elements
+            << ", \"threads\": " << b.threads << ", \"reps\": " << b.reps << ", \"kept\": " << b.kept
+            << ", \"mean_s\": " << b.mean << ", \"median_s\": " << b.median << ", \"stddev_s\": " << b.stddev
+            << ", \"min_s\": " << b.min << ", \"max_s\": " << b.max << ", \"ci95_s\": " << b.ci95 << ", \"ipc\": ";
+        if (b.has_counter[CYCLES] && b.has_counter[INSTRUCTIONS]) out << b.ipc();
+        else out << "null";
+        for (int c = 0; c < COUNTERS; ++c) {
+            out << ", \"" << counter_name(c) << "\": ";
+            if (b.has_counter[c]) out << static_cast<uint64_t>(b.counter[c]);
+            else out << "null";
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+    return static_cast<bool>(out);
+}
+
+// Writes whichever files were asked for; reports failures on stderr
+inline void write_bench_files(const BenchOptions& opt, const std::vector<BenchResult>& results) {
+    if (!opt.csv.empty() && !write_csv(opt.csv, results)) std::fprintf(stderr, "Cannot write %s\n", opt.csv.c_str());
+    if (!opt.json.empty() && !write_json(opt.json, results))
+        std::fprintf(stderr, "Cannot write %s\n", opt.json.c_str());
+}
+
+#endif // BENCHMARK_H
@@ -0,0 +1,128 @@
+// parallel_reduce.h - Generic map-reduce over an integer range
+//
+//   T r = parallel_reduce(Range{1, n}, map, combine, identity[, threads[, chunk]]);
+//
+// computes combine(...combine(identity, map(first))..., map(last)) in
+// parallel, on all hardware threads unless told otherwise. This is the sum-of-squares machinery with the kernel taken out:
+// ReduceSlot<T> is ThreadData (one page per worker, allocated by the worker
+// itself) and partial_reduce is partial_sum. map and combine are template
+// parameters, so lambdas inline into the chunk loop; there is no std::function.
+//
+// combine must be associative and commutative with identity as its
+// neutral element: chunks are stolen, so they reach a slot in any order,
+// and each chunk runs four independent partials (interleaved elements) so
+// the loop is not one long dependency chain.
+#ifndef PARALLEL_REDUCE_H
+#define PARALLEL_REDUCE_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+#include "topology.h"
+#include "work_stealing.h"
+
+constexpr uint64_t DEFAULT_REDUCE_CHUNK = 1 << 16;
+
+struct Range {
+    uint64_t first;
+    uint64_t last;   // inclusive
+};
+
+template <class T>
+struct alignas(CACHE_LINE_SIZE) ReduceSlot {
+    T value;
+};
+
+// Folds map(start..end) into slot (called once per chunk)
+template <class T, class Map, class Combine>
+inline void partial_reduce(uint64_t start, uint64_t end, ReduceSlot<T>& slot, Map& map, Combine& combine,
+                           const T& identity) {
+    // Named partials rather than an array, so they stay in registers
+    T l0 = identity, l1 = identity, l2 = identity, l3 = identity;
+    uint64_t i = start;
+    for (; i + 3 <= end; i += 4) {
+        l0 = combine(l0, map(i));
+        l1 = combine(l1, map(i + 1));
+        l2 = combine(l2, map(i + 2));
+        l3 = combine(l3, map(i + 3));
+    }
+    for (; i <= end; ++i) l0 = combine(l0, map(i));
+
+    const T local = combine(combine(l0, l1), combine(l2, l3));
+    slot.value = combine(slot.value, local);
+}
+
+template <class T>
+struct ReduceResult {
+    T value;
+    StealStats stats;
+};
+
+// One slot per worker, each a LocalBuffer allocated by its own worker before
+// its first chunk: first touch puts the slot on that worker's NUMA node
+template <class T>
+class ReduceSlots {
+public:
+    explicit ReduceSlots(unsigned threads) : slots_(threads) {}
+
+    void create(unsigned w, const T& identity) { slots_[w].create(identity); }
+    ReduceSlot<T>& operator[](unsigned w) { return *slots_[w].get(); }
+
+    template <class Combine>
+    T fold(Combine& combine, const T& identity) const {
+        T result = identity;
+        for (const auto& s : slots_)
+            if (s.get()) result = combine(result, s.get()->value);
+        return result;
+    }
+
+private:
+    std::vector<LocalBuffer<ReduceSlot<T>>> slots_;
+};
+
+// On `threads` threads created for this call. start(w) runs on each worker
+// before its first chunk (pinning, for instance).
+template <class T, class Map, class Combine, class Start>
+ReduceResult<T> parallel_reduce_stats(Range range, Map map, Combine combine, T identity, unsigned threads,
+                                      uint64_t chunk, Start start) {
+    if (threads == 0) threads = 1;
+    ReduceSlots<T> slots(threads);
+    ReduceResult<T> r{identity, StealStats()};
+    r.stats = parallel_for_chunks(threads, range.first, range.last, chunk, [&](unsigned w, uint64_t first, uint64_t last) {
+        partial_reduce(first, last, slots[w], map, combine, identity);
+    }, [&](unsigned w) {
+        start(w);
+        slots.create(w, identity);
+    });
+    r.value = slots.fold(combine, identity);
+    return r;
+}
+
+template <class T, class Map, class Combine>
+T parallel_reduce(Range range, Map map, Combine combine, T identity,
+                  unsigned threads = std::thread::hardware_concurrency(), uint64_t chunk = DEFAULT_REDUCE_CHUNK) {
+    return parallel_reduce_stats(range, map, combine, identity, threads, chunk, [](unsigned) {}).value;
+}
+
+// On the persistent workers of `pool`
+template <class T, class Map, class Combine>
+ReduceResult<T> parallel_reduce_stats(ThreadPool& pool, Range range, Map map, Combine combine, T identity,
+                                      uint64_t chunk) {
+    ReduceSlots<T> slots(pool.size());
+    ReduceResult<T> r{identity, StealStats()};
+    r.stats = parallel_for_chunks(pool, range.first, range.last, chunk, [&](unsigned w, uint64_t first, uint64_t last) {
+        partial_reduce(first, last, slots[w], map, combine, identity);
+    }, [&](unsigned w) { slots.create(w, identity); });
+    r.value = slots.fold(combine, identity);
+    return r;
+}
+
+template <class T, class Map, class Combine>
+T parallel_reduce(ThreadPool& pool, Range range, Map map, Combine combine, T identity,
+                  uint64_t chunk = DEFAULT_REDUCE_CHUNK) {
+    return parallel_reduce_stats(pool, range, map, combine, identity, chunk).value;
+}
+
+#endif // PARALLEL_REDUCE_H
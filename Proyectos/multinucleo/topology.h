@@ -0,0 +1,252 @@
+// topology.h - CPU topology from /sys and thread placement
+//
+// Each usable CPU (online and in this process's affinity mask) is tagged
+// with its NUMA node, its L3 group (a CCX on AMD: the CPUs sharing one L3)
+// and its physical core. A placement policy turns that into an ordered CPU
+// list; worker w is pinned to list[w]:
+//   - None:   no pinning, the scheduler decides (and migrates).
+//   - Pack:   fill one L3 group before the next, one thread per physical
+//             core before SMT siblings; stays on one node as long as it can.
+//   - Spread: round-robin over nodes, and over the L3 groups of each node,
+//             so every thread gets as much cache and memory bandwidth as
+//             possible.
+//
+// Accumulators become node-local by first touch: each worker allocates its
+// own after pinning itself (see LocalBuffer). No libnuma needed.
+//
+// Affinity and /sys are Linux only. Elsewhere the topology is flat (one
+// node, one L3 group, every CPU its own core) and pinning does nothing, so
+// every policy behaves like None.
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct CpuInfo {
+    int cpu = 0;
+    int node = 0;
+    int l3 = 0;        // lowest CPU sharing this CPU's L3; identifies the group
+    int core = 0;      // lowest CPU of this physical core
+    int smt = 0;       // 0 for the first hardware thread of the core, 1 for its sibling...
+};
+
+enum class Placement { None, Pack, Spread };
+
+inline const char* placement_name(Placement p) {
+    switch (p) {
+        case Placement::Pack:   return "pack";
+        case Placement::Spread: return "spread";
+        default:                return "none";
+    }
+}
+
+// Parses a kernel CPU list such as "0-3,8-11"
+inline std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) comma = text.size();
+        const std::string part = text.substr(pos, comma - pos);
+        const size_t dash = part.find('-');
+        if (!part.empty() && part[0] >= '0' && part[0] <= '9') {
+            const int lo = std::atoi(part.c_str());
+            const int hi = dash == std::string::npos ? lo : std::atoi(part.c_str() + dash + 1);
+            for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+        }
+        pos = comma + 1;
+    }
+    return cpus;
+}
+
+inline std::vector<int> read_cpu_list(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) return {};
+    return parse_cpu_list(line);
+}
+
+// Missing /sys entries (containers, other kernels) leave the defaults: one
+// node, one L3 group, every CPU its own core
+inline std::vector<CpuInfo> read_topology() {
+#ifndef __linux__
+    std::vector<CpuInfo> flat(std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t c = 0; c < flat.size(); ++c) flat[c].cpu = flat[c].core = static_cast<int>(c);
+    return flat;
+#else
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return {};
+
+    std::vector<CpuInfo> cpus;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (!CPU_ISSET(c, &mask)) continue;
+        CpuInfo info;
+        info.cpu = info.core = c;
+        const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(c);
+        const std::vector<int> siblings = read_cpu_list(base + "/topology/thread_siblings_list");
+        if (!siblings.empty()) {
+            info.core = siblings.front();
+            info.smt = static_cast<int>(std::find(siblings.begin(), siblings.end(), c) - siblings.begin());
+        }
+        const std::vector<int> l3 = read_cpu_list(base + "/cache/index3/shared_cpu_list");
+        if (!l3.empty()) info.l3 = l3.front();
+        cpus.push_back(info);
+    }
+
+    // NUMA nodes list their CPUs; absent on single-node kernels without NUMA
+    for (int n = 0; n < 1024; ++n) {
+        const std::vector<int> list = read_cpu_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+        if (list.empty()) {
+            if (n > 0) break;
+            continue;
+        }
+        for (CpuInfo& info : cpus)
+            if (std::find(list.begin(), list.end(), info.cpu) != list.end()) info.node = n;
+    }
+    return cpus;
+#endif
+}
+
+inline int count_distinct(const std::vector<CpuInfo>& cpus, int CpuInfo::*field) {
+    std::vector<int> seen;
+    for (const CpuInfo& c : cpus)
+        if (std::find(seen.begin(), seen.end(), c.*field) == seen.end()) seen.push_back(c.*field);
+    return static_cast<int>(seen.size());
+}
+
+// CPU for each of `threads` workers; empty for Placement::None, and off
+// Linux where threads cannot be pinned. With more threads than CPUs the
+// list wraps around.
+inline std::vector<int> placement_cpus(std::vector<CpuInfo> cpus, Placement policy, unsigned threads) {
+    std::vector<int> order;
+#ifndef __linux__
+    policy = Placement::None;
+#endif
+    if (policy == Placement::None || cpus.empty()) return order;
+
+    // Pack order: node, L3 group, physical cores first, then SMT siblings
+    std::sort(cpus.begin(), cpus.end(), [](const CpuInfo& a, const CpuInfo& b) {
+        if (a.node != b.node) return a.node < b.node;
+        if (a.l3 != b.l3) return a.l3 < b.l3;
+        if (a.smt != b.smt) return a.smt < b.smt;
+        return a.cpu < b.cpu;
+    });
+
+    if (policy == Placement::Pack) {
+        for (const CpuInfo& c : cpus) order.push_back(c.cpu);
+    } else {
+        // groups[node][l3] keeps the pack order; take one CPU per node per
+        // round, rotating through that node's L3 groups
+        std::vector<std::vector<std::vector<int>>> groups;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            if (i == 0 || cpus[i].node != cpus[i - 1].node) groups.emplace_back();
+            if (i == 0 || cpus[i].node != cpus[i - 1].node || cpus[i].l3 != cpus[i - 1].l3) groups.back().emplace_back();
+            groups.back().back().push_back(cpus[i].cpu);
+        }
+        std::vector<size_t> next_group(groups.size(), 0);
+        std::vector<std::vector<size_t>> taken(groups.size());
+        for (size_t n = 0; n < groups.size(); ++n) taken[n].assign(groups[n].size(), 0);
+        while (order.size() < cpus.size()) {
+            for (size_t n = 0; n < groups.size(); ++n) {
+                for (size_t tries = 0; tries < groups[n].size(); ++tries) {
+                    const size_t g = next_group[n]++ % groups[n].size();
+                    if (taken[n][g] < groups[n][g].size()) {
+                        order.push_back(groups[n][g][taken[n][g]++]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<int> result(threads);
+    for (unsigned w = 0; w < threads; ++w) result[w] = order[w % order.size()];
+    return result;
+}
+
+// false if the thread could not be pinned (always, off Linux)
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Keeps the calling thread's affinity and restores it on scope exit, for
+// code that pins the caller as worker 0
+class AffinityGuard {
+public:
+#ifdef __linux__
+    AffinityGuard() { ok_ = pthread_getaffinity_np(pthread_self(), sizeof(saved_), &saved_) == 0; }
+    ~AffinityGuard() {
+        if (ok_) pthread_setaffinity_np(pthread_self(), sizeof(saved_), &saved_);
+    }
+#else
+    AffinityGuard() {}
+    ~AffinityGuard() {}
+#endif
+    AffinityGuard(const AffinityGuard&) = delete;
+    AffinityGuard& operator=(const AffinityGuard&) = delete;
+
+#ifdef __linux__
+private:
+    cpu_set_t saved_;
+    bool ok_ = false;
+#endif
+};
+
+constexpr size_t PAGE_SIZE_BYTES = 4096;
+
+// One T on its own page, constructed (first touched) by the thread that
+// creates it, so the kernel places the page on that thread's node and no
+// other thread's data shares the page
+template <class T>
+class LocalBuffer {
+public:
+    LocalBuffer() = default;
+    LocalBuffer(const LocalBuffer&) = delete;
+    LocalBuffer& operator=(const LocalBuffer&) = delete;
+    ~LocalBuffer() { reset(); }
+
+    template <class... Args>
+    T& create(Args&&... args) {
+        reset();
+        // Aligned operator new rather than std::aligned_alloc, which MSVC lacks
+        void* p = ::operator new((sizeof(T) + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES,
+                                 std::align_val_t(PAGE_SIZE_BYTES));
+        ptr_ = new (p) T{std::forward<Args>(args)...};
+        return *ptr_;
+    }
+    T* get() const { return ptr_; }
+
+    void reset() {
+        if (ptr_) {
+            ptr_->~T();
+            ::operator delete(ptr_, std::align_val_t(PAGE_SIZE_BYTES));
+            ptr_ = nullptr;
+        }
+    }
+
+private:
+    T* ptr_ = nullptr;
+};
+
+#endif // TOPOLOGY_H
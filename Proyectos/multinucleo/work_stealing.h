@@ -0,0 +1,183 @@
+// work_stealing.h - Chunked parallel loop over a range with work stealing
+//
+// The range [first, last] is cut into fixed-size chunks. Each worker starts
+// with a contiguous block of chunks in its own deque and takes chunks from
+// the front; when its deque runs dry it steals from the back of another
+// worker's deque. Stolen chunks are the ones farthest from the owner's
+// current position, so owners keep walking memory in order.
+//
+// A deque is just a [head, tail) range of chunk indices packed into one
+// 64-bit atomic, so both the owner and the thieves update it with a single
+// compare-and-swap. Each deque sits on its own cache line.
+//
+// The loop runs either on threads created for the call or on the
+// persistent workers of a ThreadPool.
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+constexpr size_t CACHE_LINE_SIZE = 64;  // AMD cache line size
+
+class ChunkDeque {
+public:
+    void reset(uint32_t head, uint32_t tail) {
+        range_.store(pack(head, tail), std::memory_order_relaxed);
+    }
+
+    // Owner side: take the chunk at the front
+    bool pop(uint32_t& chunk) {
+        uint64_t cur = range_.load(std::memory_order_relaxed);
+        while (head_of(cur) < tail_of(cur)) {
+            if (range_.compare_exchange_weak(cur, pack(head_of(cur) + 1, tail_of(cur)),
+                                             std::memory_order_acq_rel)) {
+                chunk = head_of(cur);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Thief side: take the chunk at the back
+    bool steal(uint32_t& chunk) {
+        uint64_t cur = range_.load(std::memory_order_relaxed);
+        while (head_of(cur) < tail_of(cur)) {
+            if (range_.compare_exchange_weak(cur, pack(head_of(cur), tail_of(cur) - 1),
+                                             std::memory_order_acq_rel)) {
+                chunk = tail_of(cur) - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static uint64_t pack(uint32_t head, uint32_t tail) { return (uint64_t(head) << 32) | tail; }
+    static uint32_t head_of(uint64_t v) { return static_cast<uint32_t>(v >> 32); }
+    static uint32_t tail_of(uint64_t v) { return static_cast<uint32_t>(v); }
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> range_{0};
+};
+
+struct StealStats {
+    uint64_t chunks = 0;
+    uint64_t steals = 0;   // chunks run by a worker other than their initial owner
+};
+
+// Chunks of [first, last] dealt out to `threads` deques. work(w, body) runs
+// worker w's share plus whatever it can steal; every worker calls it once,
+// on whatever thread runs it.
+class ChunkScheduler {
+public:
+    ChunkScheduler(unsigned threads, uint64_t first, uint64_t last, uint64_t chunk)
+        : threads_(threads == 0 ? 1 : threads), first_(first), last_(last), chunk_(chunk == 0 ? 1 : chunk),
+          deques_(threads_) {
+        if (last < first) return;
+        const uint64_t count = last - first + 1;
+        chunks_ = (count + chunk_ - 1) / chunk_;
+        if (chunks_ > UINT32_MAX) {                  // keep chunk indices in 32 bits
+            chunks_ = UINT32_MAX;
+            chunk_ = (count + chunks_ - 1) / chunks_;
+            chunks_ = (count + chunk_ - 1) / chunk_;
+        }
+        for (unsigned w = 0; w < threads_; ++w) {
+            deques_[w].reset(static_cast<uint32_t>(chunks_ * w / threads_),
+                             static_cast<uint32_t>(chunks_ * (w + 1) / threads_));
+        }
+    }
+
+    unsigned threads() const { return threads_; }
+
+    template <class Body>
+    void work(unsigned w, Body& body) {
+        auto run = [&](uint32_t c) {
+            const uint64_t start = first_ + uint64_t(c) * chunk_;
+            const uint64_t end = start + chunk_ - 1 < last_ ? start + chunk_ - 1 : last_;
+            body(w, start, end);
+        };
+        uint32_t c;
+        uint64_t stolen = 0;
+        while (deques_[w].pop(c)) run(c);
+        // Own deque empty: sweep the others, starting with the next worker
+        for (bool found = true; found;) {
+            found = false;
+            for (unsigned k = 1; k < threads_; ++k) {
+                if (deques_[(w + k) % threads_].steal(c)) {
+                    run(c);
+                    ++stolen;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        if (stolen) steals_.fetch_add(stolen, std::memory_order_relaxed);
+    }
+
+    StealStats stats() const {
+        StealStats s;
+        s.chunks = chunks_;
+        s.steals = steals_.load();
+        return s;
+    }
+
+private:
+    unsigned threads_;
+    uint64_t first_, last_, chunk_;
+    uint64_t chunks_ = 0;
+    std::vector<ChunkDeque> deques_;
+    std::atomic<uint64_t> steals_{0};
+};
+
+// Runs body(worker, start, end) over [first, last] in chunks of `chunk`
+// elements (end inclusive) using `threads` workers; the calling thread is
+// worker 0. Each worker calls start(worker) on its own thread before taking
+// any chunk (for pinning and thread-local setup). Returns how many chunks
+// had to be stolen.
+template <class Body, class Start>
+StealStats parallel_for_chunks(unsigned threads, uint64_t first, uint64_t last, uint64_t chunk, Body body,
+                               Start start) {
+    if (last < first) return StealStats();
+    ChunkScheduler scheduler(threads, first, last, chunk);
+    auto worker = [&](unsigned w) {
+        start(w);
+        scheduler.work(w, body);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned w = 1; w < scheduler.threads(); ++w) pool.emplace_back(worker, w);
+    worker(0);
+    for (auto& t : pool) t.join();
+    return scheduler.stats();
+}
+
+template <class Body>
+StealStats parallel_for_chunks(unsigned threads, uint64_t first, uint64_t last, uint64_t chunk, Body body) {
+    return parallel_for_chunks(threads, first, last, chunk, body, [](unsigned) {});
+}
+
+// Same loop on the persistent workers of `pool` (pool.size() workers, no
+// thread creation); start(worker) runs on each worker at the start of the run
+template <class Body, class Start>
+StealStats parallel_for_chunks(ThreadPool& pool, uint64_t first, uint64_t last, uint64_t chunk, Body body,
+                               Start start) {
+    if (last < first) return StealStats();
+    ChunkScheduler scheduler(pool.size(), first, last, chunk);
+    auto worker = [&](unsigned w) {
+        start(w);
+        scheduler.work(w, body);
+    };
+    pool.run(worker);
+    return scheduler.stats();
+}
+
+template <class Body>
+StealStats parallel_for_chunks(ThreadPool& pool, uint64_t first, uint64_t last, uint64_t chunk, Body body) {
+    return parallel_for_chunks(pool, first, last, chunk, body, [](unsigned) {});
+}
+
+#endif // WORK_STEALING_H